@@ -21,3 +21,22 @@ project "gou"
    configuration "Release"
       flags { "Optimize" }
       defines { "NDEBUG" }
+
+project "gou_test"
+   location (output)
+   kind "ConsoleApp"
+   language "C++"
+   files { "tests/**.cpp" }
+   includedirs { "src" }
+   links { "gou" }
+   buildoptions { "-Wall" }
+   linkoptions { "-lpthread -lpng" }
+   defines { "EGL_NO_X11" }
+
+   configuration "Debug"
+      flags { "Symbols" }
+      defines { "DEBUG" }
+
+   configuration "Release"
+      flags { "Optimize" }
+      defines { "NDEBUG" }
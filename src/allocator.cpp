@@ -0,0 +1,378 @@
+/*
+libgou - Support library for the ODROID-GO Ultra
+Copyright (C) 2022 OtherCrashOverride
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "allocator.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <linux/types.h>
+
+#include "ion.h"
+
+
+// dma-heap and udmabuf uapi (not present in older kernel headers)
+#ifndef DMA_HEAP_IOCTL_ALLOC
+struct dma_heap_allocation_data {
+	__u64 len;
+	__u32 fd;
+	__u32 fd_flags;
+	__u64 heap_flags;
+};
+#define DMA_HEAP_IOCTL_ALLOC	_IOWR('H', 0x0, struct dma_heap_allocation_data)
+#endif
+
+#ifndef UDMABUF_CREATE
+struct udmabuf_create {
+	__u32 memfd;
+	__u32 flags;
+	__u64 offset;
+	__u64 size;
+};
+#define UDMABUF_FLAGS_CLOEXEC	0x01
+#define UDMABUF_CREATE		_IOW('u', 0x42, struct udmabuf_create)
+#endif
+
+
+#define ALIGN(val, align)	(((val) + (align) - 1) & ~((align) - 1))
+
+
+static int ion_fd = -1;
+static int system_heap_fd = -1;
+static int cma_heap_fd = -1;
+static int udmabuf_fd = -1;
+static bool udmabuf_probed = false;
+
+static gou_allocator_t defaultAllocator = GOU_ALLOCATOR_AUTO;
+
+
+// ION
+static bool IonOpen()
+{
+    if (ion_fd < 0)
+    {
+        ion_fd = open("/dev/ion", O_RDWR);
+    }
+
+    return ion_fd >= 0;
+}
+
+static bool IonAlloc(size_t size, bool cached, uint64_t* outHandle)
+{
+    ion_allocation_data allocation_data = { 0 };
+    allocation_data.len = size;
+    allocation_data.heap_id_mask = (1 << ION_HEAP_TYPE_DMA);
+    allocation_data.flags = cached ? (ION_FLAG_CACHED | ION_FLAG_CACHED_NEEDS_SYNC) : 0;
+
+    int io = ioctl(ion_fd, ION_IOC_ALLOC, &allocation_data);
+    if (io != 0)
+    {
+        printf("ION_IOC_ALLOC failed.\n");
+        return false;
+    }
+
+    *outHandle = (uint32_t)allocation_data.handle;
+    return true;
+}
+
+static int IonShare(uint64_t handle)
+{
+    ion_fd_data ionData = { 0 };
+    ionData.handle = (ion_user_handle_t)handle;
+
+    int io = ioctl(ion_fd, ION_IOC_SHARE, &ionData);
+    if (io != 0)
+    {
+        printf("ION_IOC_SHARE failed.\n");
+        return -1;
+    }
+
+    return ionData.fd;
+}
+
+static void IonFree(uint64_t handle)
+{
+    ion_handle_data ionHandleData = { 0 };
+    ionHandleData.handle = (ion_user_handle_t)handle;
+
+    int io = ioctl(ion_fd, ION_IOC_FREE, &ionHandleData);
+    if (io != 0)
+    {
+        printf("ION_IOC_FREE failed.\n");
+        abort();
+    }
+}
+
+static void IonCpuSync(int share_fd, bool start, bool read, bool write)
+{
+    // Invalidate before the CPU reads and clean after the CPU writes.
+    ion_fd_data ionData = { 0 };
+    ionData.fd = share_fd;
+
+    if (start && read)
+    {
+        int io = ioctl(ion_fd, ION_IOC_INVALID_CACHE, &ionData);
+        if (io != 0)
+        {
+            printf("ION_IOC_INVALID_CACHE failed.\n");
+            abort();
+        }
+    }
+    else if (!start && write)
+    {
+        int io = ioctl(ion_fd, ION_IOC_SYNC, &ionData);
+        if (io != 0)
+        {
+            printf("ION_IOC_SYNC failed.\n");
+            abort();
+        }
+    }
+}
+
+
+// dma-heap
+static bool DmaHeapSystemOpen()
+{
+    if (system_heap_fd < 0)
+    {
+        system_heap_fd = open("/dev/dma_heap/system", O_RDWR | O_CLOEXEC);
+    }
+
+    return system_heap_fd >= 0;
+}
+
+static bool DmaHeapCmaOpen()
+{
+    // The name of the CMA heap depends on the device tree
+    static const char* names[] = {
+        "/dev/dma_heap/linux,cma",
+        "/dev/dma_heap/reserved",
+        "/dev/dma_heap/cma"
+    };
+
+    for (size_t i = 0; cma_heap_fd < 0 && i < sizeof(names) / sizeof(names[0]); ++i)
+    {
+        cma_heap_fd = open(names[i], O_RDWR | O_CLOEXEC);
+    }
+
+    return cma_heap_fd >= 0;
+}
+
+static bool DmaHeapAlloc(int heap_fd, size_t size, uint64_t* outHandle)
+{
+    dma_heap_allocation_data allocation_data = { 0 };
+    allocation_data.len = size;
+    allocation_data.fd_flags = O_RDWR | O_CLOEXEC;
+
+    int io = ioctl(heap_fd, DMA_HEAP_IOCTL_ALLOC, &allocation_data);
+    if (io != 0)
+    {
+        printf("DMA_HEAP_IOCTL_ALLOC failed.\n");
+        return false;
+    }
+
+    *outHandle = allocation_data.fd;
+    return true;
+}
+
+// System heap memory is always cached
+static bool DmaHeapSystemAlloc(size_t size, bool cached, uint64_t* outHandle)
+{
+    return DmaHeapAlloc(system_heap_fd, size, outHandle);
+}
+
+static bool DmaHeapCmaAlloc(size_t size, bool cached, uint64_t* outHandle)
+{
+    return DmaHeapAlloc(cma_heap_fd, size, outHandle);
+}
+
+// Used by backends whose handle is already a file descriptor
+static int FdShare(uint64_t handle)
+{
+    int fd = dup((int)handle);
+    if (fd < 0)
+    {
+        printf("dup failed.\n");
+    }
+
+    return fd;
+}
+
+static void FdFree(uint64_t handle)
+{
+    close((int)handle);
+}
+
+
+// memfd
+static bool MemfdOpen()
+{
+    // udmabuf turns the memfd into a real dma-buf when available
+    if (!udmabuf_probed)
+    {
+        udmabuf_fd = open("/dev/udmabuf", O_RDWR | O_CLOEXEC);
+        udmabuf_probed = true;
+    }
+
+    return true;
+}
+
+static bool MemfdAlloc(size_t size, bool cached, uint64_t* outHandle)
+{
+    size = ALIGN(size, (size_t)sysconf(_SC_PAGESIZE));
+
+    int memfd = memfd_create("gou_surface", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memfd < 0)
+    {
+        printf("memfd_create failed.\n");
+        return false;
+    }
+
+    if (ftruncate(memfd, size) != 0)
+    {
+        printf("ftruncate failed.\n");
+        close(memfd);
+        return false;
+    }
+
+    if (udmabuf_fd >= 0 && fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK) == 0)
+    {
+        udmabuf_create create = { 0 };
+        create.memfd = memfd;
+        create.flags = UDMABUF_FLAGS_CLOEXEC;
+        create.offset = 0;
+        create.size = size;
+
+        int dmabuf = ioctl(udmabuf_fd, UDMABUF_CREATE, &create);
+        if (dmabuf >= 0)
+        {
+            // The dma-buf holds a reference to the pages
+            close(memfd);
+            memfd = dmabuf;
+        }
+    }
+
+    *outHandle = memfd;
+    return true;
+}
+
+
+static const gou_allocator_backend_t backends[GOU_ALLOCATOR_MAX] = {
+    { "auto", NULL, NULL, NULL, NULL, NULL },
+    { "ion", IonOpen, IonAlloc, IonShare, IonFree, IonCpuSync },
+    { "system", DmaHeapSystemOpen, DmaHeapSystemAlloc, FdShare, FdFree, NULL },
+    { "cma", DmaHeapCmaOpen, DmaHeapCmaAlloc, FdShare, FdFree, NULL },
+    { "memfd", MemfdOpen, MemfdAlloc, FdShare, FdFree, NULL }
+};
+
+
+gou_allocator_t gou_allocator_default_get()
+{
+    if (defaultAllocator == GOU_ALLOCATOR_AUTO)
+    {
+        const char* env = getenv("GOU_ALLOCATOR");
+        if (env)
+        {
+            for (int i = GOU_ALLOCATOR_AUTO + 1; i < GOU_ALLOCATOR_MAX; ++i)
+            {
+                if (strcmp(env, backends[i].name) == 0 && gou_allocator_available((gou_allocator_t)i))
+                {
+                    defaultAllocator = (gou_allocator_t)i;
+                    break;
+                }
+            }
+
+            if (defaultAllocator == GOU_ALLOCATOR_AUTO)
+            {
+                printf("GOU_ALLOCATOR=%s is not available.\n", env);
+            }
+        }
+    }
+
+    if (defaultAllocator == GOU_ALLOCATOR_AUTO)
+    {
+        // Prefer physically contiguous memory that GE2D can scan out
+        static const gou_allocator_t order[] = {
+            GOU_ALLOCATOR_ION,
+            GOU_ALLOCATOR_DMA_HEAP_CMA,
+            GOU_ALLOCATOR_DMA_HEAP_SYSTEM,
+            GOU_ALLOCATOR_MEMFD
+        };
+
+        for (size_t i = 0; i < sizeof(order) / sizeof(order[0]); ++i)
+        {
+            if (gou_allocator_available(order[i]))
+            {
+                defaultAllocator = order[i];
+                break;
+            }
+        }
+
+        printf("gou_allocator: using %s\n", backends[defaultAllocator].name);
+    }
+
+    return defaultAllocator;
+}
+
+void gou_allocator_default_set(gou_allocator_t value)
+{
+    if (value < GOU_ALLOCATOR_AUTO || value >= GOU_ALLOCATOR_MAX)
+    {
+        printf("gou_allocator_default_set: invalid allocator (%d).\n", value);
+        abort();
+    }
+
+    defaultAllocator = value;
+}
+
+bool gou_allocator_available(gou_allocator_t value)
+{
+    if (value <= GOU_ALLOCATOR_AUTO || value >= GOU_ALLOCATOR_MAX) return false;
+
+    return backends[value].open();
+}
+
+const char* gou_allocator_name_get(gou_allocator_t value)
+{
+    if (value < GOU_ALLOCATOR_AUTO || value >= GOU_ALLOCATOR_MAX) return "invalid";
+
+    return backends[value].name;
+}
+
+const gou_allocator_backend_t* gou_allocator_backend_get(gou_allocator_t value)
+{
+    if (value == GOU_ALLOCATOR_AUTO)
+    {
+        value = gou_allocator_default_get();
+    }
+
+    if (!gou_allocator_available(value))
+    {
+        printf("gou_allocator: %s is not available.\n", gou_allocator_name_get(value));
+        abort();
+    }
+
+    return &backends[value];
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+/*
+libgou - Support library for the ODROID-GO Ultra
+Copyright (C) 2022 OtherCrashOverride
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+typedef enum gou_allocator
+{
+    GOU_ALLOCATOR_AUTO = 0,
+    GOU_ALLOCATOR_ION,
+    GOU_ALLOCATOR_DMA_HEAP_SYSTEM,
+    GOU_ALLOCATOR_DMA_HEAP_CMA,
+    GOU_ALLOCATOR_MEMFD,
+
+    GOU_ALLOCATOR_MAX
+} gou_allocator_t;
+
+typedef struct gou_allocator_backend
+{
+    const char* name;
+    bool (*open)(void);
+    bool (*alloc)(size_t size, bool cached, uint64_t* outHandle);
+
+    // Returns a new dma-buf (or memfd) owned by the caller
+    int (*share)(uint64_t handle);
+    void (*free)(uint64_t handle);
+
+    // Cache maintenance for exporters without DMA_BUF_IOCTL_SYNC. May be NULL.
+    void (*cpu_sync)(int share_fd, bool start, bool read, bool write);
+} gou_allocator_backend_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The default is taken from the GOU_ALLOCATOR environment variable
+// (ion, system, cma or memfd) or else the first available backend.
+gou_allocator_t gou_allocator_default_get();
+void gou_allocator_default_set(gou_allocator_t value);
+bool gou_allocator_available(gou_allocator_t value);
+const char* gou_allocator_name_get(gou_allocator_t value);
+const gou_allocator_backend_t* gou_allocator_backend_get(gou_allocator_t value);
+
+
+#ifdef __cplusplus
+}
+#endif
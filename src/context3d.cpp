@@ -21,6 +21,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include "surface.h"
 
+#include <vector>
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -35,17 +37,29 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #include <GLES2/gl2ext.h>
 
 
+// A surface supplied by the application, such as a scanout buffer
+typedef struct context3d_target
+{
+    gou_surface_t* surface;
+    EGLImageKHR image;
+    GLuint texture2D;
+} context3d_target_t;
+
 typedef struct gou_context3d
 {
     EGLDisplay eglDisplay;
     EGLSurface eglSurface;
     EGLContext eglContext;
     
+    int width;
+    int height;
     gou_surface_t* surface;
     EGLImageKHR image;
     GLuint fbo;
     GLuint depthBuffer;
     GLuint texture2D;
+    gou_surface_t* target;  // rendered into instead of surface when set
+    std::vector<context3d_target_t>* targets;   // EGLImages kept for reuse
 } gou_context3d_t;
 
 
@@ -135,16 +149,34 @@ static void CreateContext(gou_context3d_t* context, EGLint glMajor, EGLint glMin
 
 static EGLImageKHR CreateEglImage(gou_context3d_t* context, gou_surface_t* surface)
 {
-    EGLint img_attrs[] = {
-        EGL_WIDTH, gou_surface_width_get(surface),
-        EGL_HEIGHT, gou_surface_height_get(surface),
-        EGL_LINUX_DRM_FOURCC_EXT, gou_surface_format_get(surface),
-        EGL_DMA_BUF_PLANE0_FD_EXT, gou_surface_share_fd(surface),
-        EGL_DMA_BUF_PLANE0_OFFSET_EXT, 0,
-        EGL_DMA_BUF_PLANE0_PITCH_EXT, gou_surface_stride_get(surface),
-        EGL_NONE
+    static const EGLint planeAttributes[][3] = {
+        { EGL_DMA_BUF_PLANE0_FD_EXT, EGL_DMA_BUF_PLANE0_OFFSET_EXT, EGL_DMA_BUF_PLANE0_PITCH_EXT },
+        { EGL_DMA_BUF_PLANE1_FD_EXT, EGL_DMA_BUF_PLANE1_OFFSET_EXT, EGL_DMA_BUF_PLANE1_PITCH_EXT },
+        { EGL_DMA_BUF_PLANE2_FD_EXT, EGL_DMA_BUF_PLANE2_OFFSET_EXT, EGL_DMA_BUF_PLANE2_PITCH_EXT }
     };
 
+    EGLint img_attrs[6 + GOU_SURFACE_MAX_PLANES * 6 + 1];
+    int count = 0;
+
+    img_attrs[count++] = EGL_WIDTH;
+    img_attrs[count++] = gou_surface_width_get(surface);
+    img_attrs[count++] = EGL_HEIGHT;
+    img_attrs[count++] = gou_surface_height_get(surface);
+    img_attrs[count++] = EGL_LINUX_DRM_FOURCC_EXT;
+    img_attrs[count++] = (EGLint)gou_surface_format_get(surface);
+
+    for (int i = 0; i < gou_surface_plane_count_get(surface); ++i)
+    {
+        img_attrs[count++] = planeAttributes[i][0];
+        img_attrs[count++] = gou_surface_share_fd(surface);
+        img_attrs[count++] = planeAttributes[i][1];
+        img_attrs[count++] = gou_surface_offset_get(surface) + gou_surface_plane_offset_get(surface, i);
+        img_attrs[count++] = planeAttributes[i][2];
+        img_attrs[count++] = gou_surface_plane_stride_get(surface, i);
+    }
+
+    img_attrs[count++] = EGL_NONE;
+
     static PFNEGLCREATEIMAGEKHRPROC p_eglCreateImageKHR = (PFNEGLCREATEIMAGEKHRPROC)eglGetProcAddress("eglCreateImageKHR");
     if (!p_eglCreateImageKHR) abort();
 
@@ -158,6 +190,16 @@ static EGLImageKHR CreateEglImage(gou_context3d_t* context, gou_surface_t* surfa
     return eglImage;
 }
 
+// Backs the texture bound to GL_TEXTURE_2D with the image
+static void TextureImageSet(EGLImageKHR eglImage)
+{
+    static PFNGLEGLIMAGETARGETTEXTURE2DOESPROC p_glEGLImageTargetTexture2DOES = (PFNGLEGLIMAGETARGETTEXTURE2DOESPROC)eglGetProcAddress("glEGLImageTargetTexture2DOES");
+    if (!p_glEGLImageTargetTexture2DOES) abort();
+
+    p_glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, eglImage);
+    GLCheckError();
+}
+
 static void DestroyEglImage(gou_context3d_t* context, EGLImageKHR eglImage)
 {
     static PFNEGLDESTROYIMAGEKHRPROC p_eglDestroyImageKHR = (PFNEGLDESTROYIMAGEKHRPROC)eglGetProcAddress("eglDestroyImageKHR");
@@ -181,16 +223,27 @@ gou_context3d_t* gou_context3d_create(gou_display_t* display, int width, int hei
 
 
     result->depthBuffer = 0;
+    result->width = width;
+    result->height = height;
+    result->targets = new std::vector<context3d_target_t>;
 
 
-    uint32_t format;
-    if (attributes->red_bits == 5 && attributes->green_bits == 6 && attributes->blue_bits == 5)
-    {
-        format = DRM_FORMAT_RGB565;
-    }
-    else
+    // Pick the first renderable format matching the requested color depth
+    static const uint32_t candidates[] = { DRM_FORMAT_RGB565, DRM_FORMAT_ABGR8888 };
+
+    uint32_t format = DRM_FORMAT_ABGR8888;
+    for (size_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); ++i)
     {
-        format = DRM_FORMAT_ABGR8888;
+        const gou_format_info_t* info = gou_format_info_get(candidates[i]);
+        if (info->gl_internal_format != 0 &&
+            info->r.bits == attributes->red_bits &&
+            info->g.bits == attributes->green_bits &&
+            info->b.bits == attributes->blue_bits &&
+            info->a.bits >= attributes->alpha_bits)
+        {
+            format = candidates[i];
+            break;
+        }
     }
     
     
@@ -222,11 +275,7 @@ gou_context3d_t* gou_context3d_create(gou_display_t* display, int width, int hei
     // glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     // GLCheckError();
 
-    static PFNGLEGLIMAGETARGETTEXTURE2DOESPROC p_glEGLImageTargetTexture2DOES = (PFNGLEGLIMAGETARGETTEXTURE2DOESPROC)eglGetProcAddress("glEGLImageTargetTexture2DOES");
-    if (!p_glEGLImageTargetTexture2DOES) abort();
-
-    p_glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, result->image);
-    GLCheckError();
+    TextureImageSet(result->image);
 
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,	result->texture2D, 0);
     GLCheckError();
@@ -301,10 +350,97 @@ gou_surface_t* gou_context3d_surface_lock(gou_context3d_t* context)
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
     glFinish();
 
-    return context->surface;
+    return context->target ? context->target : context->surface;
 }
 
 void gou_context3d_surface_unlock(gou_context3d_t* context, gou_surface_t* surface)
 {
     glBindFramebuffer(GL_FRAMEBUFFER, context->fbo);
 }
+
+void gou_context3d_target_set(gou_context3d_t* context, gou_surface_t* surface)
+{
+    GLuint texture2D = context->texture2D;
+
+    if (surface && surface != context->surface)
+    {
+        // The depth buffer is shared by every target
+        if (gou_surface_width_get(surface) != context->width ||
+            gou_surface_height_get(surface) != context->height)
+        {
+            printf("gou_context3d_target_set: surface size (%d x %d) does not match the context (%d x %d).\n",
+                gou_surface_width_get(surface), gou_surface_height_get(surface), context->width, context->height);
+            abort();
+        }
+
+        size_t i = 0;
+        while (i < context->targets->size() && (*context->targets)[i].surface != surface)
+        {
+            ++i;
+        }
+
+        if (i == context->targets->size())
+        {
+            context3d_target_t target;
+            target.surface = surface;
+            target.image = CreateEglImage(context, surface);
+
+            glGenTextures(1, &target.texture2D);
+            GLCheckError();
+
+            glBindTexture(GL_TEXTURE_2D, target.texture2D);
+            GLCheckError();
+
+            TextureImageSet(target.image);
+
+            context->targets->push_back(target);
+        }
+
+        texture2D = (*context->targets)[i].texture2D;
+    }
+    else
+    {
+        surface = NULL;
+    }
+
+    context->target = surface;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, context->fbo);
+    GLCheckError();
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture2D, 0);
+    GLCheckError();
+
+    // A format the GPU cannot render to is only reported here
+    GLenum fboStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (fboStatus != GL_FRAMEBUFFER_COMPLETE)
+    {
+        printf("gou_context3d_target_set: FBO not complete (status=0x%x).\n", fboStatus);
+        abort();
+    }
+}
+
+void gou_context3d_target_release(gou_context3d_t* context, gou_surface_t* surface)
+{
+    for (size_t i = 0; i < context->targets->size(); ++i)
+    {
+        context3d_target_t& target = (*context->targets)[i];
+        if (target.surface != surface)
+        {
+            continue;
+        }
+
+        if (context->target == surface)
+        {
+            gou_context3d_target_set(context, NULL);
+        }
+
+        glDeleteTextures(1, &target.texture2D);
+        GLCheckError();
+
+        DestroyEglImage(context, target.image);
+
+        context->targets->erase(context->targets->begin() + i);
+        break;
+    }
+}
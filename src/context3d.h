@@ -50,6 +50,14 @@ void gou_context3d_make_current(gou_context3d_t* context);
 void gou_context3d_swap_buffers(gou_context3d_t* context);
 gou_surface_t* gou_context3d_surface_lock(gou_context3d_t* context);
 void gou_context3d_surface_unlock(gou_context3d_t* context, gou_surface_t* surface);
+// Renders into surface instead of the context's own surface until called
+// again; NULL switches back. The surface must be the size of the context,
+// e.g. one from gou_display_scanout_acquire with a context created at
+// panel size, and is imported as an EGLImage once then reused.
+void gou_context3d_target_set(gou_context3d_t* context, gou_surface_t* surface);
+// Drops the EGLImage kept for surface; call before destroying it. A current
+// target switches back to the context's own surface.
+void gou_context3d_target_release(gou_context3d_t* context, gou_surface_t* surface);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,337 @@
+/*
+libgou - Support library for the ODROID-GO Ultra
+Copyright (C) 2022 OtherCrashOverride
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "convert.h"
+#include "worker_pool.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define CONVERT_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define CONVERT_SSE2
+#endif
+
+
+#define MAX_REPLICATE   (8)
+
+// Images smaller than this are converted on the calling thread
+#define PARALLEL_PIXELS (128 * 1024)
+
+
+typedef struct channel_plan
+{
+    int shift;
+    uint32_t mask;
+    int count;
+    int replicate[MAX_REPLICATE];   // > 0 shifts left, < 0 shifts right
+    int dstShift;
+} channel_plan_t;
+
+typedef struct convert_plan
+{
+    int bpp;
+    int channelCount;
+    channel_plan_t channels[4];
+    uint32_t constant;              // opaque alpha when the source has none
+} convert_plan_t;
+
+typedef struct convert_job
+{
+    const convert_plan_t* plan;
+    const uint8_t* src;
+    int srcStride;
+    uint8_t* dst;
+    int dstStride;
+    int width;
+    int height;
+} convert_job_t;
+
+
+// Expanding an n bit value to 8 bits by repeating its bit pattern maps
+// 0 to 0 and the maximum to 255.
+static void PlanChannel(channel_plan_t* channel, gou_format_component_t component, int dstShift)
+{
+    channel->shift = component.shift;
+    channel->mask = (1u << component.bits) - 1;
+    channel->dstShift = dstShift;
+    channel->count = 0;
+
+    if (component.bits >= 8)
+    {
+        channel->replicate[channel->count++] = -(component.bits - 8);
+    }
+    else
+    {
+        for (int s = 8 - component.bits; s > -component.bits; s -= component.bits)
+        {
+            channel->replicate[channel->count++] = s;
+        }
+    }
+}
+
+static void BuildPlan(convert_plan_t* plan, const gou_format_info_t* format)
+{
+    memset(plan, 0, sizeof(*plan));
+
+    plan->bpp = format->bpp;
+
+    PlanChannel(&plan->channels[plan->channelCount++], format->r, 16);
+    PlanChannel(&plan->channels[plan->channelCount++], format->g, 8);
+    PlanChannel(&plan->channels[plan->channelCount++], format->b, 0);
+
+    if (format->a.bits)
+    {
+        PlanChannel(&plan->channels[plan->channelCount++], format->a, 24);
+    }
+    else
+    {
+        plan->constant = 0xff000000;
+    }
+}
+
+static inline uint32_t ConvertPixel(const convert_plan_t* plan, uint32_t pixel)
+{
+    uint32_t result = plan->constant;
+
+    for (int i = 0; i < plan->channelCount; ++i)
+    {
+        const channel_plan_t& channel = plan->channels[i];
+        const uint32_t value = (pixel >> channel.shift) & channel.mask;
+
+        uint32_t expanded = 0;
+        for (int j = 0; j < channel.count; ++j)
+        {
+            const int s = channel.replicate[j];
+            expanded |= (s >= 0) ? (value << s) : (value >> -s);
+        }
+
+        result |= expanded << channel.dstShift;
+    }
+
+    return result;
+}
+
+
+#if defined(CONVERT_NEON)
+
+static inline uint32x4_t ConvertVector(const convert_plan_t* plan, uint32x4_t pixels)
+{
+    uint32x4_t result = vdupq_n_u32(plan->constant);
+
+    for (int i = 0; i < plan->channelCount; ++i)
+    {
+        const channel_plan_t& channel = plan->channels[i];
+        const uint32x4_t value = vandq_u32(vshlq_u32(pixels, vdupq_n_s32(-channel.shift)), vdupq_n_u32(channel.mask));
+
+        uint32x4_t expanded = vdupq_n_u32(0);
+        for (int j = 0; j < channel.count; ++j)
+        {
+            expanded = vorrq_u32(expanded, vshlq_u32(value, vdupq_n_s32(channel.replicate[j])));
+        }
+
+        result = vorrq_u32(result, vshlq_u32(expanded, vdupq_n_s32(channel.dstShift)));
+    }
+
+    return result;
+}
+
+// Returns the number of pixels converted
+static int ConvertRowVector(const convert_plan_t* plan, const uint8_t* src, uint32_t* dst, int width)
+{
+    int x = 0;
+
+    if (plan->bpp == 16)
+    {
+        for (; x + 8 <= width; x += 8)
+        {
+            const uint16x8_t pixels = vld1q_u16((const uint16_t*)src + x);
+            vst1q_u32(dst + x, ConvertVector(plan, vmovl_u16(vget_low_u16(pixels))));
+            vst1q_u32(dst + x + 4, ConvertVector(plan, vmovl_u16(vget_high_u16(pixels))));
+        }
+    }
+    else if (plan->bpp == 32)
+    {
+        for (; x + 4 <= width; x += 4)
+        {
+            vst1q_u32(dst + x, ConvertVector(plan, vld1q_u32((const uint32_t*)src + x)));
+        }
+    }
+
+    return x;
+}
+
+#elif defined(CONVERT_SSE2)
+
+static inline __m128i ShiftVector(__m128i value, int shift)
+{
+    return (shift >= 0) ? _mm_sll_epi32(value, _mm_cvtsi32_si128(shift)) : _mm_srl_epi32(value, _mm_cvtsi32_si128(-shift));
+}
+
+static inline __m128i ConvertVector(const convert_plan_t* plan, __m128i pixels)
+{
+    __m128i result = _mm_set1_epi32((int)plan->constant);
+
+    for (int i = 0; i < plan->channelCount; ++i)
+    {
+        const channel_plan_t& channel = plan->channels[i];
+        const __m128i value = _mm_and_si128(ShiftVector(pixels, -channel.shift), _mm_set1_epi32((int)channel.mask));
+
+        __m128i expanded = _mm_setzero_si128();
+        for (int j = 0; j < channel.count; ++j)
+        {
+            expanded = _mm_or_si128(expanded, ShiftVector(value, channel.replicate[j]));
+        }
+
+        result = _mm_or_si128(result, ShiftVector(expanded, channel.dstShift));
+    }
+
+    return result;
+}
+
+// Returns the number of pixels converted
+static int ConvertRowVector(const convert_plan_t* plan, const uint8_t* src, uint32_t* dst, int width)
+{
+    int x = 0;
+
+    if (plan->bpp == 16)
+    {
+        const __m128i zero = _mm_setzero_si128();
+
+        for (; x + 8 <= width; x += 8)
+        {
+            const __m128i pixels = _mm_loadu_si128((const __m128i*)((const uint16_t*)src + x));
+            _mm_storeu_si128((__m128i*)(dst + x), ConvertVector(plan, _mm_unpacklo_epi16(pixels, zero)));
+            _mm_storeu_si128((__m128i*)(dst + x + 4), ConvertVector(plan, _mm_unpackhi_epi16(pixels, zero)));
+        }
+    }
+    else if (plan->bpp == 32)
+    {
+        for (; x + 4 <= width; x += 4)
+        {
+            _mm_storeu_si128((__m128i*)(dst + x), ConvertVector(plan, _mm_loadu_si128((const __m128i*)((const uint32_t*)src + x))));
+        }
+    }
+
+    return x;
+}
+
+#else
+
+static int ConvertRowVector(const convert_plan_t* plan, const uint8_t* src, uint32_t* dst, int width)
+{
+    return 0;
+}
+
+#endif
+
+
+static void ConvertRows(const convert_job_t* job, int y0, int y1)
+{
+    const convert_plan_t* plan = job->plan;
+
+    for (int y = y0; y < y1; ++y)
+    {
+        const uint8_t* src = job->src + (size_t)y * job->srcStride;
+        uint32_t* dst = (uint32_t*)(job->dst + (size_t)y * job->dstStride);
+
+        int x = ConvertRowVector(plan, src, dst, job->width);
+
+        switch (plan->bpp)
+        {
+            case 16:
+                for (; x < job->width; ++x)
+                {
+                    dst[x] = ConvertPixel(plan, ((const uint16_t*)src)[x]);
+                }
+                break;
+
+            case 24:
+                for (; x < job->width; ++x)
+                {
+                    const uint8_t* p = src + x * 3;
+                    dst[x] = ConvertPixel(plan, p[0] | (p[1] << 8) | (p[2] << 16));
+                }
+                break;
+
+            case 32:
+                for (; x < job->width; ++x)
+                {
+                    dst[x] = ConvertPixel(plan, ((const uint32_t*)src)[x]);
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+
+static void ConvertBand(const void* arg, int band, int bandCount)
+{
+    const convert_job_t* job = (const convert_job_t*)arg;
+
+    const int y0 = (int)((int64_t)job->height * band / bandCount);
+    const int y1 = (int)((int64_t)job->height * (band + 1) / bandCount);
+    ConvertRows(job, y0, y1);
+}
+
+
+bool gou_convert_supported(const gou_format_info_t* srcFormat)
+{
+    return srcFormat && !srcFormat->yuv &&
+        srcFormat->r.bits && srcFormat->g.bits && srcFormat->b.bits &&
+        (srcFormat->bpp == 16 || srcFormat->bpp == 24 || srcFormat->bpp == 32);
+}
+
+void gou_convert_to_argb8888(const gou_format_info_t* srcFormat, const void* src, int srcStride,
+                             void* dst, int dstStride, int width, int height)
+{
+    if (!gou_convert_supported(srcFormat))
+    {
+        printf("gou_convert_to_argb8888: unsupported format.\n");
+        abort();
+    }
+
+    convert_plan_t plan;
+    BuildPlan(&plan, srcFormat);
+
+    convert_job_t job;
+    job.plan = &plan;
+    job.src = (const uint8_t*)src;
+    job.srcStride = srcStride;
+    job.dst = (uint8_t*)dst;
+    job.dstStride = dstStride;
+    job.width = width;
+    job.height = height;
+
+    if (width * height >= PARALLEL_PIXELS)
+    {
+        gou_worker_pool_run(ConvertBand, &job, gou_worker_pool_size_get());
+    }
+    else
+    {
+        ConvertRows(&job, 0, height);
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+/*
+libgou - Support library for the ODROID-GO Ultra
+Copyright (C) 2022 OtherCrashOverride
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "format.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// True for packed RGB formats that can be converted to ARGB8888
+bool gou_convert_supported(const gou_format_info_t* srcFormat);
+
+// Converts a rectangle of packed RGB pixels to ARGB8888. Large images are
+// split into row bands processed in parallel.
+void gou_convert_to_argb8888(const gou_format_info_t* srcFormat, const void* src, int srcStride,
+                             void* dst, int dstStride, int width, int height);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -21,10 +21,21 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #include "dirent.h"
 
 #include "surface.h"
+#include "surface_pool.h"
+#include "frame_arena.h"
+#include "convert.h"
+#include "frame_queue.h"
+#include "virtual_fb.h"
+#include "soft_ge2d.h"
+#include "screenshot.h"
+#include "recorder.h"
 
 #include <queue>
+#include <vector>
+#include <algorithm>
 
 #include <stdio.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
@@ -39,94 +50,277 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #include <drm/drm_fourcc.h>
 #include <linux/dma-buf.h>
 #include <linux/kd.h>
-#include <semaphore.h>
 #include <pthread.h>
 
 #include "ge2d.h"
 #include "ge2d_cmd.h"
+#include "ge2d_func.h"
+#include "osd.h"
 
 #include "surface.h"
 
 
-#define FBIOGET_OSD_DMABUF               0x46fc
-struct fb_dmabuf_export {
-	__u32 buffer_idx;
-	__u32 fd;
-	__u32 flags;
-};
+// The kernel keeps the last configuration per GE2D file handle, so an
+// identical configuration does not need to be issued again.
+typedef struct ge2d_state
+{
+    int fd;
+    gou_soft_ge2d_t* soft;  // CPU engine used instead of fd when set
+    config_ge2d_para_ex_s config;
+    uint32_t shareFdGeneration; // the config's fds refer to the same buffers while unchanged
+    bool valid;
+    uint64_t configHits;
+    uint64_t configMisses;
+    unsigned int scaleCoef;
+    uint64_t queued;        // operations issued
+    uint64_t completed;     // operations known to have finished
+    pthread_mutex_t mutex;
+    pthread_cond_t completedCond;
+} ge2d_state_t;
+
+typedef struct present_job
+{
+    gou_display_fence_t fence;
+    gou_display_layer_t layers[GOU_DISPLAY_MAX_LAYERS];
+    gou_surface_t* staging[GOU_DISPLAY_MAX_LAYERS];
+    int layerCount;
+    int framebuffer;
+    bool direct;        // drawn into the flip buffer by the application
+} present_job_t;
+
+// What a flip buffer holds outside the content drawn into it
+typedef struct framebuffer_state
+{
+    bool valid;
+    uint32_t backgroundColor;
+    gou_rect_t dirty;   // bounds of everything drawn over the background
+} framebuffer_state_t;
 
 typedef struct gou_display
 {
     int fd;
     int width;
     int height;
-    std::queue<int>* freeFrameBuffers;
-    std::queue<int>* usedFrameBuffers;
-    pthread_mutex_t queueMutex;
-    sem_t freeSem;
-    sem_t usedSem;
+    int bufferCount;
+    gou_frame_queue_t* freeFrameBuffers;    // pushed only by RenderThread
+    gou_frame_queue_t* usedFrameBuffers;    // pushed only by BlitThread
     pthread_t renderThread; 
-    bool terminating;
+    std::queue<present_job_t>* jobs;
+    pthread_mutex_t jobMutex;
+    pthread_cond_t jobCond;
+    pthread_cond_t fenceCond;
+    gou_display_fence_t nextFence;
+    gou_display_fence_t completedFence;
+    pthread_t blitThread;
+    bool blitTerminating;
+    bool ge2dSyncRequested;         // a capture is waiting on GE2D
+    gou_surface_t* ge2dSyncSurface; // target of the blit thread's sync, NULL if soft
+    std::vector<framebuffer_state_t>* frameBufferStates;
+    std::vector<gou_display_frame_timing_t>* frameBufferTimings;    // frame held by each flip buffer
+    pthread_mutex_t statsMutex;
+    std::vector<gou_display_frame_timing_t>* timingHistory;
+    int timingHistoryNext;
+    uint64_t framesPresented;
+    uint64_t framesShown;
+    uint64_t framesDropped;
+    uint64_t missedVBlanks;
     uint32_t backgroundColor;
+    gou_present_mode_t presentMode;
+    gou_scale_filter_t scaleFilter;
+    gou_frame_arena_t* frameArena;
+    gou_surface_pool_t* stagingPool;
+    gou_surface_t* sharpSurfaces[GOU_DISPLAY_MAX_LAYERS];   // one per layer slot
+    gou_virtual_fb_t* virtualFb;
+    bool restoreVarInfo;            // the buffer count was changed from originalVarInfo
+    fb_var_screeninfo originalVarInfo;
+    ge2d_state_t* ge2d;
+    void* fbMap;        // OSD0 as seen by the software GE2D
+    size_t fbMapSize;
+    pthread_mutex_t scanoutMutex;   // keeps the visible buffer from being recycled
+    int visibleFrameBuffer;         // -1 until the first flip
+    std::vector<gou_surface_t*>* scanoutSurfaces;   // flip buffers exported on first use
+    std::vector<bool>* scanoutAcquired;     // acquired and not yet presented
+    gou_surface_pool_t* screenshotPool;
+    gou_screenshot_writer_t* screenshotWriter;
+    gou_recorder_t* recorder;       // set and cleared with the scanout mutex held
+    gou_recorder_stats_t recorderStats; // from the last recording stopped
 } gou_display_t;
 
 
-static int ge2d_fd = -1;
+static uint64_t MicrosecondsGet()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+// Headless defaults match the handheld's panel
+#define VIRTUAL_DEFAULT_WIDTH (480)
+#define VIRTUAL_DEFAULT_HEIGHT (854)
+#define VIRTUAL_DEFAULT_REFRESH_RATE (60)
+#define VIRTUAL_MAX_BUFFERS (4)
+
+
+// Enough for a few full screen staging surfaces
+#define STAGING_POOL_BUDGET (16 * 1024 * 1024)
+
+// Captures waiting to be encoded; more are refused rather than queued
+#define SCREENSHOT_MAX_PENDING (2)
+#define SCREENSHOT_POOL_BUDGET (4 * 1024 * 1024)
+
+
+
+// The driver starts every context with bilinear scaler coefficients
+static ge2d_state_t ge2d_device = { -1, NULL, {}, 0, false, 0, 0, FILTER_TYPE_BILINEAR, 0, 0,
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
 
 
-static uint32_t GE2DFormat(uint32_t drm_fourcc)
+static int Ge2dIoctl(ge2d_state_t* state, unsigned long request, void* arg)
 {
-    switch (drm_fourcc)
+    if (state->soft)
     {
-        // 32bit
-        case DRM_FORMAT_RGBA8888:
-        case DRM_FORMAT_RGBX8888:
-            return GE2D_FORMAT_S32_RGBA;
-    
-        case DRM_FORMAT_BGRX8888:
-            return GE2D_FORMAT_S32_BGRA;
-   
-        case DRM_FORMAT_ARGB8888:
-        case DRM_FORMAT_XRGB8888:
-            return GE2D_FORMAT_S32_ARGB;
-    
-        case DRM_FORMAT_ABGR8888:
-        case DRM_FORMAT_XBGR8888:
-            return GE2D_FORMAT_S32_ABGR;
+        return gou_soft_ge2d_ioctl(state->soft, request, arg);
+    }
 
+    return ioctl(state->fd, request, arg);
+}
 
-        // 24bit
-        case DRM_FORMAT_RGB888:
-            return GE2D_FORMAT_S24_RGB;
- 
-        case DRM_FORMAT_BGR888:
-            return GE2D_FORMAT_S24_BGR;
+// Must be called with the GE2D state mutex held. A context runs its
+// operations in order, so one that blocks has also finished everything
+// queued before it. The software engine finishes every operation.
+static int Ge2dOperation(ge2d_state_t* state, unsigned long request, void* arg, bool block)
+{
+    const int io = Ge2dIoctl(state, request, arg);
 
+    ++state->queued;
+    if (block || state->soft)
+    {
+        state->completed = state->queued;
+        pthread_cond_broadcast(&state->completedCond);
+    }
 
-        // 16bit
-        case DRM_FORMAT_RGB565:
-            return GE2D_FORMAT_S16_RGB_565;
+    return io;
+}
 
-        case DRM_FORMAT_RGBA5551:
-            return GE2D_FORMAT_S16_ARGB_1555;
-    
-        case DRM_FORMAT_RGBA4444:
-            return GE2D_FORMAT_S16_RGBA_4444;
+static int FbIoctl(gou_display_t* display, unsigned long request, void* arg)
+{
+    if (display->virtualFb)
+    {
+        return gou_virtual_fb_ioctl(display->virtualFb, request, arg);
+    }
 
-    
-        default:
-            printf("GE2D not supported. ");
-            printf("drm_fourcc=%c%c%c%c\n", drm_fourcc & 0xff, drm_fourcc >> 8 & 0xff, drm_fourcc >> 16 & 0xff, drm_fourcc >> 24);
-            abort();
+    return ioctl(display->fd, request, arg);
+}
+
+
+// Must be called with the GE2D state mutex held
+static void ConfigureGE2D(ge2d_state_t* state, config_ge2d_para_ex_s* ex_mem)
+{
+    const uint32_t shareFdGeneration = gou_surface_share_fd_generation_get();
+
+    if (state->valid && state->shareFdGeneration == shareFdGeneration &&
+        memcmp(&state->config, ex_mem, sizeof(*ex_mem)) == 0)
+    {
+        ++state->configHits;
+        return;
+    }
+
+    ++state->configMisses;
+
+    int io = Ge2dIoctl(state, GE2D_CONFIG_EX_MEM, ex_mem);
+    if (io < 0)
+    {
+        printf("GE2D_CONFIG failed\n");
+        abort();
+    }
+
+    state->config = *ex_mem;
+    state->shareFdGeneration = shareFdGeneration;
+    state->valid = true;
+}
+
+
+// Must be called with the GE2D state mutex held
+static void SetScaleCoef(ge2d_state_t* state, unsigned int filterType)
+{
+    if (state->scaleCoef == filterType)
+    {
+        return;
+    }
+
+    // Vertical type in the low byte, horizontal type in the upper half
+    int io = Ge2dIoctl(state, GE2D_SET_COEF, (void*)(uintptr_t)(filterType | (filterType << 16)));
+    if (io < 0)
+    {
+        printf("GE2D_SET_COEF failed.\n");
+        abort();
+    }
+
+    state->scaleCoef = filterType;
+}
+
+// Phases are 24 bit fractions of a source pixel. Samples are aligned to
+// pixel centers; an upscale starts before the first pixel so it is
+// repeated once. A downscale can start whole pixels in, which the phase
+// cannot hold, so they are returned in outOffset.
+static void ScalePhase(int srcSize, int dstSize, bool nearest, unsigned int* outPhase, int* outRepeat, int* outOffset)
+{
+    const uint64_t ONE = 1 << 24;
+
+    // Position of the first sample relative to the first source pixel,
+    // offset by half a pixel, in 24 bit fixed point
+    const uint64_t halfRatio = ((uint64_t)srcSize << 24) / dstSize / 2;
+
+    uint64_t start;
+    if (nearest)
+    {
+        // Phase 0 always selects the pixel below, so round by half a pixel
+        start = halfRatio;
+        *outRepeat = 0;
+    }
+    else if (halfRatio >= ONE / 2)
+    {
+        start = halfRatio - ONE / 2;
+        *outRepeat = 0;
+    }
+    else
+    {
+        start = halfRatio + ONE / 2;
+        *outRepeat = 1;
+    }
+
+    *outPhase = (unsigned int)(start & (ONE - 1));
+    *outOffset = *outRepeat ? 0 : (int)(start >> 24);
+}
+
+static void ShiftSourceRange(int* start, int* size, int offset, int surfaceSize, bool mirror)
+{
+    const int room = mirror ? *start : surfaceSize - (*start + *size);
+
+    if (!mirror)
+    {
+        *start += offset;
+    }
+    else if (offset <= room)
+    {
+        *start -= offset;
+    }
+
+    if (offset > room)
+    {
+        *size -= offset;
     }
 }
 
-static void ClearScreen(uint32_t color, int width, int height, int fullWidth, int fullHeight, int voffset)
+static void ClearScreen(ge2d_state_t* state, uint32_t color, int x, int y, int width, int height, int fullWidth, int fullHeight, int voffset)
 {
     int io;
 
 
-    config_ge2d_para_ex_s ex_mem = { 0 };
+    config_ge2d_para_ex_s ex_mem;
+    memset(&ex_mem, 0, sizeof(ex_mem));
 
     config_para_ex_ion_s& fill_config = ex_mem.para_config_memtype._ge2d_config_ex;
 
@@ -154,12 +348,8 @@ static void ClearScreen(uint32_t color, int width, int height, int fullWidth, in
     ex_mem.para_config_memtype.dst_mem_alloc_type = AML_GE2D_MEM_INVALID;
 
 
-    io = ioctl(ge2d_fd, GE2D_CONFIG_EX_MEM, &ex_mem);
-    if (io < 0)
-    {
-        printf("GE2D_CONFIG failed\n");
-        abort();
-    }
+    pthread_mutex_lock(&state->mutex);
+    ConfigureGE2D(state, &ex_mem);
 
 
     // Convert ABGR -> RGBA
@@ -172,33 +362,97 @@ static void ClearScreen(uint32_t color, int width, int height, int fullWidth, in
     // Perform the fill operation
     ge2d_para_s fillRect = { 0 };
 
-    fillRect.src1_rect.x = 0;
-    fillRect.src1_rect.y = voffset;
+    fillRect.src1_rect.x = x;
+    fillRect.src1_rect.y = y + voffset;
     fillRect.src1_rect.w = width;
     fillRect.src1_rect.h = height;
     fillRect.color = rgba;
 
-    io = ioctl(ge2d_fd, GE2D_FILLRECTANGLE, &fillRect);
+    // GE2D executes in order so the blit that follows waits for the fill
+    io = Ge2dOperation(state, GE2D_FILLRECTANGLE_NOBLOCK, &fillRect, false);
     if (io < 0)
     {
-        printf("GE2D_FILLRECTANGLE failed.\n");
+        printf("GE2D_FILLRECTANGLE_NOBLOCK failed.\n");
         abort();
     }
+
+    pthread_mutex_unlock(&state->mutex);
+}
+
+// The global alpha is the constant color's alpha. For COVERAGE and
+// PREMULTIPLIED it also scales the source alpha (src1_gb_alpha).
+static unsigned int BlendOp(gou_blend_mode_t blendMode, uint8_t alpha)
+{
+    switch (blendMode)
+    {
+        case GOU_BLEND_MODE_PREMULTIPLIED:
+            // Premultiplied color is scaled by the global alpha directly
+            return blendop(BLENDOP_ADD, (alpha != 0xff) ? COLOR_FACTOR_CONST_ALPHA : COLOR_FACTOR_ONE, COLOR_FACTOR_ONE_MINUS_SRC_ALPHA,
+                BLENDOP_ADD, ALPHA_FACTOR_ONE, ALPHA_FACTOR_ONE_MINUS_SRC_ALPHA);
+
+        case GOU_BLEND_MODE_COVERAGE:
+            return blendop(BLENDOP_ADD, COLOR_FACTOR_SRC_ALPHA, COLOR_FACTOR_ONE_MINUS_SRC_ALPHA,
+                BLENDOP_ADD, ALPHA_FACTOR_ONE, ALPHA_FACTOR_ONE_MINUS_SRC_ALPHA);
+
+        case GOU_BLEND_MODE_NONE:
+        default:
+            // An opaque layer with a global alpha ignores the source alpha
+            return blendop(BLENDOP_ADD, COLOR_FACTOR_CONST_ALPHA, COLOR_FACTOR_ONE_MINUS_CONST_ALPHA,
+                BLENDOP_ADD, ALPHA_FACTOR_CONST_ALPHA, ALPHA_FACTOR_ONE_MINUS_CONST_ALPHA);
+    }
+}
+
+static void SurfacePlanes(gou_surface_t* surface, config_planes_ion_s* outPlanes)
+{
+    const int planeCount = gou_surface_plane_count_get(surface);
+    if (planeCount == 1)
+    {
+        const gou_format_info_t* format_info = gou_surface_format_info_get(surface);
+
+        outPlanes[0].shared_fd = gou_surface_share_fd(surface);
+        outPlanes[0].addr = gou_surface_offset_get(surface);
+        outPlanes[0].w = gou_surface_stride_get(surface) / (format_info->bpp / 8);
+        outPlanes[0].h = gou_surface_height_get(surface);
+    }
+    else
+    {
+        // All planes are 8 bits per sample so plane width is the stride in bytes
+        for (int i = 0; i < planeCount; ++i)
+        {
+            int plane = i;
+
+            // GE2D expects Y, Cb, Cr order
+            if (gou_surface_format_get(surface) == DRM_FORMAT_YVU420 && i > 0)
+            {
+                plane = 3 - i;
+            }
+
+            outPlanes[i].shared_fd = gou_surface_share_fd(surface);
+            outPlanes[i].addr = gou_surface_offset_get(surface) + gou_surface_plane_offset_get(surface, plane);
+            outPlanes[i].w = gou_surface_plane_stride_get(surface, plane);
+            outPlanes[i].h = (i == 0) ? gou_surface_height_get(surface) : (gou_surface_height_get(surface) + 1) / 2;
+        }
+    }
 }
 
-static void Blit(gou_surface_t* src, int srcX, int srcY, int srcWidth, int srcHeight, bool hMirror, bool yMirror,
-          int dstX, int dstY, int dstWidth, int dstHeight, int fullWidth, int fullHeight, int voffset, gou_rotation_t rotation)
+// A NULL dst targets the framebuffer
+static void Blit(ge2d_state_t* state, gou_surface_t* src, int srcX, int srcY, int srcWidth, int srcHeight, bool hMirror, bool yMirror,
+          gou_surface_t* dst, int dstX, int dstY, int dstWidth, int dstHeight, int fullWidth, int fullHeight, int voffset, gou_rotation_t rotation,
+          gou_blend_mode_t blendMode, uint8_t alpha, gou_scale_filter_t filter, bool block)
 {
     int io;
 
-    config_ge2d_para_ex_s ex_mem = { 0 };
+    config_ge2d_para_ex_s ex_mem;
+    memset(&ex_mem, 0, sizeof(ex_mem));
 
     config_para_ex_ion_s& blit_config = ex_mem.para_config_memtype._ge2d_config_ex;
 
     blit_config.alu_const_color = 0xffffffff;
 
     blit_config.src_para.mem_type = CANVAS_ALLOC;
-    blit_config.src_para.format = GE2DFormat(gou_surface_format_get(src));
+    const gou_format_info_t* format_info = gou_surface_format_info_get(src);
+
+    blit_config.src_para.format = format_info->ge2d_format;
 
     blit_config.src_para.left = 0;
     blit_config.src_para.top = 0;
@@ -207,9 +461,7 @@ static void Blit(gou_surface_t* src, int srcX, int srcY, int srcWidth, int srcHe
     blit_config.src_para.x_rev = hMirror ? 1 : 0;
     blit_config.src_para.y_rev = yMirror ? 1 : 0;
 
-    blit_config.src_planes[0].shared_fd = gou_surface_share_fd(src);
-    blit_config.src_planes[0].w = gou_surface_stride_get(src) / (gou_drm_format_get_bpp(gou_surface_format_get(src)) / 8);
-    blit_config.src_planes[0].h = gou_surface_height_get(src);
+    SurfacePlanes(src, blit_config.src_planes);
   
 
     ex_mem.para_config_memtype.src1_mem_alloc_type = AML_GE2D_MEM_ION;
@@ -232,7 +484,44 @@ static void Blit(gou_surface_t* src, int srcX, int srcY, int srcWidth, int srcHe
 
     ex_mem.para_config_memtype.dst_mem_alloc_type = AML_GE2D_MEM_INVALID;
 
+    if (dst)
+    {
+        const gou_format_info_t* dst_format_info = gou_surface_format_info_get(dst);
+
+        blit_config.dst_para.mem_type = CANVAS_ALLOC;
+        blit_config.dst_para.format = dst_format_info->ge2d_format;
+
+        SurfacePlanes(dst, blit_config.dst_planes);
+
+        ex_mem.para_config_memtype.dst_mem_alloc_type = AML_GE2D_MEM_ION;
+    }
+
  
+    // The scaler works on source axes before any destination swap
+    unsigned int filterType = FILTER_TYPE_BILINEAR;
+    if (filter != GOU_SCALE_FILTER_DEFAULT && dstWidth > 0 && dstHeight > 0)
+    {
+        const bool nearest = (filter == GOU_SCALE_FILTER_NEAREST);
+        if (filter == GOU_SCALE_FILTER_BICUBIC)
+        {
+            filterType = FILTER_TYPE_BICUBIC;
+        }
+
+        int offsetX;
+        int offsetY;
+        ScalePhase(srcWidth, dstWidth, nearest, &blit_config.hf_init_phase, &blit_config.hf_rpt_num, &offsetX);
+        ScalePhase(srcHeight, dstHeight, nearest, &blit_config.vf_init_phase, &blit_config.vf_rpt_num, &offsetY);
+
+        // Whole pixels move the source rectangle away from the end it is
+        // read from, the far end when mirrored. Its size sets the step, so
+        // it is only trimmed when the surface has no room to move it.
+        ShiftSourceRange(&srcX, &srcWidth, offsetX, gou_surface_width_get(src), hMirror);
+        ShiftSourceRange(&srcY, &srcHeight, offsetY, gou_surface_height_get(src), yMirror);
+
+        blit_config.src1_hsc_phase0_always_en = nearest ? 1 : 0;
+        blit_config.src1_vsc_phase0_always_en = nearest ? 1 : 0;
+    }
+
     int tmp;
     switch (rotation)
     {
@@ -267,14 +556,34 @@ static void Blit(gou_surface_t* src, int srcX, int srcY, int srcWidth, int srcHe
     }
 
 
-    io = ioctl(ge2d_fd, GE2D_CONFIG_EX_MEM, &ex_mem);
-    if (io < 0)
+    // The X byte of formats without alpha is undefined, so they are opaque
+    if (format_info->a.bits == 0)
     {
-        printf("GE2D_CONFIG failed\n");
-        abort();
+        blendMode = GOU_BLEND_MODE_NONE;
+    }
+
+    const bool blend = (blendMode != GOU_BLEND_MODE_NONE || alpha != 0xff);
+    if (blend)
+    {
+        // The framebuffer is read back as the second source, at the
+        // position being written and without the rotation's mirroring
+        blit_config.src2_para = blit_config.dst_para;
+        blit_config.src2_para.x_rev = 0;
+        blit_config.src2_para.y_rev = 0;
+        blit_config.src2_planes[0] = blit_config.dst_planes[0];
+        ex_mem.para_config_memtype.src2_mem_alloc_type = ex_mem.para_config_memtype.dst_mem_alloc_type;
+
+        blit_config.alu_const_color = 0xffffff00 | alpha;
+        blit_config.src1_gb_alpha_en = (alpha != 0xff && blendMode != GOU_BLEND_MODE_NONE) ? 1 : 0;
+        blit_config.src1_gb_alpha = alpha;
     }
 
 
+    pthread_mutex_lock(&state->mutex);
+    SetScaleCoef(state, filterType);
+    ConfigureGE2D(state, &ex_mem);
+
+
     ge2d_para_s blitRect = { 0 };
 
     blitRect.src1_rect.x = srcX;
@@ -288,187 +597,1174 @@ static void Blit(gou_surface_t* src, int srcX, int srcY, int srcWidth, int srcHe
     blitRect.dst_rect.h = dstHeight;
 
 
-    io = ioctl(ge2d_fd, GE2D_STRETCHBLIT, &blitRect);
-    if (io < 0)
+    if (blend)
     {
-        printf("GE2D_STRETCHBLIT failed.\n");
-        abort();
+        blitRect.src2_rect = blitRect.dst_rect;
+        blitRect.op = BlendOp(blendMode, alpha);
+
+        io = Ge2dOperation(state, block ? GE2D_BLEND : GE2D_BLEND_NOBLOCK, &blitRect, block);
+        if (io < 0)
+        {
+            printf("GE2D_BLEND failed.\n");
+            abort();
+        }
+    }
+    else
+    {
+        io = Ge2dOperation(state, block ? GE2D_STRETCHBLIT : GE2D_STRETCHBLIT_NOBLOCK, &blitRect, block);
+        if (io < 0)
+        {
+            printf("GE2D_STRETCHBLIT failed.\n");
+            abort();
+        }
     }
+
+    pthread_mutex_unlock(&state->mutex);
 }
 
 
-static void* RenderThread(void* arg)
+// Read after queuing, so it may also cover later operations
+static uint64_t Ge2dQueuedGet(ge2d_state_t* state)
 {
-    gou_display_t* obj = (gou_display_t*)arg;
+    pthread_mutex_lock(&state->mutex);
+    const uint64_t result = state->queued;
+    pthread_mutex_unlock(&state->mutex);
 
-    int prevFrameBuffer = -1;
+    return result;
+}
+
+// Finishes everything queued with one blocking operation. Only the blit
+// thread issues it, or destroy once that thread has stopped.
+static void SyncGe2d(gou_display_t* display)
+{
+    ge2d_state_t* state = display->ge2d;
 
+    pthread_mutex_lock(&state->mutex);
+    const bool pending = (state->completed < state->queued);
+    pthread_mutex_unlock(&state->mutex);
 
-    fb_var_screeninfo var_info;
-    if (ioctl(obj->fd, FBIOGET_VSCREENINFO, &var_info) < 0)
+    if (pending)
     {
-        printf("FBIOGET_VSCREENINFO failed.\n");
-        abort();
+        gou_surface_t* target = display->ge2dSyncSurface;
+        Blit(state, target, 0, 0, 1, 1, false, false,
+            target, 0, 0, 1, 1, 1, 1, 0, GOU_ROTATION_DEGREES_0,
+            GOU_BLEND_MODE_NONE, 0xff, GOU_SCALE_FILTER_DEFAULT, true);
     }
+}
 
-    const int buffer_count = var_info.yres_virtual / var_info.yres;
-    printf("RenderThread: buffer_count=%d\n", buffer_count);
+// Returns once the operations up to sequence have finished. While frames
+// are composited their final blocking blit finishes earlier captures;
+// otherwise the blit thread is asked to sync.
+static void WaitGe2d(gou_display_t* display, uint64_t sequence)
+{
+    ge2d_state_t* state = display->ge2d;
 
-    int current_buffer = 0;
+    pthread_mutex_lock(&state->mutex);
+    const bool done = (state->completed >= sequence);
+    pthread_mutex_unlock(&state->mutex);
 
-    obj->terminating = false;
-    while(true)
+    if (done)
     {
-        sem_wait(&obj->usedSem);
-        if(obj->terminating) break;
+        return;
+    }
 
+    pthread_mutex_lock(&display->jobMutex);
+    display->ge2dSyncRequested = true;
+    pthread_cond_signal(&display->jobCond);
+    pthread_mutex_unlock(&display->jobMutex);
 
-        pthread_mutex_lock(&obj->queueMutex);
+    pthread_mutex_lock(&state->mutex);
 
-        if (obj->usedFrameBuffers->size() < 1)
-        {
-            pthread_mutex_unlock(&obj->queueMutex);
+    while (state->completed < sequence)
+    {
+        pthread_cond_wait(&state->completedCond, &state->mutex);
+    }
 
-            printf("no framebuffer available.\n");
-            abort();
-        }
+    pthread_mutex_unlock(&state->mutex);
+}
 
-        int framebuffer = obj->usedFrameBuffers->front();
-        obj->usedFrameBuffers->pop();
 
-        pthread_mutex_unlock(&obj->queueMutex);
+// Converts the source rectangle of a surface GE2D cannot read into a
+// pooled ARGB8888 staging surface at the same coordinates.
+static gou_surface_t* ConvertToStaging(gou_display_t* display, gou_surface_t* src, int srcX, int srcY, int srcWidth, int srcHeight)
+{
+    if (!display->stagingPool)
+    {
+        display->stagingPool = gou_surface_pool_create(display, STAGING_POOL_BUDGET);
+    }
 
+    gou_surface_t* staging = gou_surface_pool_acquire(display->stagingPool,
+        gou_surface_width_get(src), gou_surface_height_get(src), DRM_FORMAT_ARGB8888);
+    if (!staging)
+    {
+        printf("ConvertToStaging: staging surface allocation failed.\n");
+        return NULL;
+    }
 
- 
+    const gou_format_info_t* format_info = gou_surface_format_info_get(src);
+    const int srcStride = gou_surface_stride_get(src);
+    const int dstStride = gou_surface_stride_get(staging);
 
-        // Swap buffers
-        var_info.yoffset = framebuffer;
-#if 0
-        if (ioctl(obj->fd, FBIO_WAITFORVSYNC, 0) < 0)
-        {
-            printf("FBIO_WAITFORVSYNC failed.\n");
-            abort();
-        }
+    gou_rect_t rect = { srcX, srcY, srcWidth, srcHeight };
+    gou_surface_begin_cpu_access(src, GOU_SURFACE_ACCESS_READ, &rect);
+    gou_surface_begin_cpu_access(staging, GOU_SURFACE_ACCESS_WRITE, &rect);
 
-        if (ioctl(obj->fd, FBIOPAN_DISPLAY, &var_info) < 0)
-        {
-            printf("FBIOPAN_DISPLAY failed.\n");
-            abort();
-        }
-#else
-        if (ioctl(obj->fd, FBIOPUT_VSCREENINFO, &var_info) < 0) 
-        {
-            printf("FBIOPUT_VSCREENINFO failed.\n");
-            abort();
-        }
-#endif
+    const uint8_t* srcPixels = (const uint8_t*)gou_surface_map(src) + srcY * srcStride + srcX * (format_info->bpp / 8);
+    uint8_t* dstPixels = (uint8_t*)gou_surface_map(staging) + srcY * dstStride + srcX * 4;
 
-        ++current_buffer;
-        current_buffer %= buffer_count;
+    gou_convert_to_argb8888(format_info, srcPixels, srcStride, dstPixels, dstStride, srcWidth, srcHeight);
 
-        //printf("FbDevDisplay: frame - current_buffer=%d\n", current_buffer);
-        
-        if (prevFrameBuffer >= 0)
-        {
-            pthread_mutex_lock(&obj->queueMutex);
-            obj->freeFrameBuffers->push(prevFrameBuffer);
-            pthread_mutex_unlock(&obj->queueMutex);
+    gou_surface_end_cpu_access(staging, GOU_SURFACE_ACCESS_WRITE, &rect);
+    gou_surface_end_cpu_access(src, GOU_SURFACE_ACCESS_READ, NULL);
 
-            sem_post(&obj->freeSem);
-        }
+    return staging;
+}
 
-        prevFrameBuffer = framebuffer;            
+
+static bool IntersectRect(const gou_rect_t& a, const gou_rect_t& b, gou_rect_t* outRect)
+{
+    const int left = (a.x > b.x) ? a.x : b.x;
+    const int top = (a.y > b.y) ? a.y : b.y;
+    const int right = (a.x + a.width < b.x + b.width) ? a.x + a.width : b.x + b.width;
+    const int bottom = (a.y + a.height < b.y + b.height) ? a.y + a.height : b.y + b.height;
+
+    if (right <= left || bottom <= top)
+    {
+        return false;
     }
 
+    outRect->x = left;
+    outRect->y = top;
+    outRect->width = right - left;
+    outRect->height = bottom - top;
 
-    return NULL;
+    return true;
 }
 
+static gou_rect_t UnionRect(const gou_rect_t& a, const gou_rect_t& b)
+{
+    if (a.width <= 0 || a.height <= 0) return b;
+    if (b.width <= 0 || b.height <= 0) return a;
 
-gou_display_t* gou_display_create()
+    const int left = (a.x < b.x) ? a.x : b.x;
+    const int top = (a.y < b.y) ? a.y : b.y;
+    const int right = (a.x + a.width > b.x + b.width) ? a.x + a.width : b.x + b.width;
+    const int bottom = (a.y + a.height > b.y + b.height) ? a.y + a.height : b.y + b.height;
+
+    gou_rect_t result = { left, top, right - left, bottom - top };
+    return result;
+}
+
+// Maps a destination rect to the rotated framebuffer
+static gou_rect_t FrameBufferRect(gou_display_t* display, const gou_rect_t& dst)
 {
-    if (ge2d_fd < 0)
+    gou_rect_t result = { dst.y, display->height - (dst.x + dst.width), dst.height, dst.width };
+    return result;
+}
+
+// Fills only the part of the background that the bottom layer does not
+// cover and that is not already known to hold the background color.
+static void ClearBackground(gou_display_t* display, const present_job_t& job, const fb_var_screeninfo& var_info)
+{
+    const gou_rect_t screen = { 0, 0, (int)var_info.xres, (int)var_info.yres };
+
+    gou_rect_t covered = { 0, 0, 0, 0 };
+    const gou_display_layer_t& bottom = job.layers[0];
+    if (bottom.blend_mode == GOU_BLEND_MODE_NONE && bottom.alpha == 0xff)
     {
-        ge2d_fd = open("/dev/ge2d", O_RDWR);
-        if (ge2d_fd < 0)
+        if (!IntersectRect(FrameBufferRect(display, bottom.dst), screen, &covered))
         {
-            printf("open /dev/ge2d failed.\n");
-            abort();
+            covered = { 0, 0, 0, 0 };
         }
     }
 
-    gou_display_t* result = (gou_display_t*)malloc(sizeof(gou_display_t));
-    if (!result)
+    framebuffer_state_t& state = display->frameBufferStates->at(job.framebuffer / var_info.yres);
+
+    gou_rect_t stale = screen;
+    if (state.valid && state.backgroundColor == display->backgroundColor)
     {
-        printf("malloc failed.\n");
-        abort();
+        stale = state.dirty;
     }
 
-    memset(result, 0, sizeof(*result));
-
-    
-    result->backgroundColor = (0xff000000);
-    result->freeFrameBuffers = new std::queue<int>;
-    result->usedFrameBuffers = new std::queue<int>;
-
+    // Borders around the covered rect: top, bottom, left, right
+    gou_rect_t borders[4];
+    int borderCount = 0;
 
-    // Open device
-    result->fd = open("/dev/fb0", O_RDWR);
-    if (result->fd < 0)
+    if (covered.width <= 0 || covered.height <= 0)
     {
-        printf("open /dev/fb0 failed.\n");
-        abort();
+        borders[borderCount++] = screen;
+    }
+    else
+    {
+        borders[borderCount++] = { 0, 0, screen.width, covered.y };
+        borders[borderCount++] = { 0, covered.y + covered.height, screen.width, screen.height - (covered.y + covered.height) };
+        borders[borderCount++] = { 0, covered.y, covered.x, covered.height };
+        borders[borderCount++] = { covered.x + covered.width, covered.y, screen.width - (covered.x + covered.width), covered.height };
     }
 
- 
-    // Properties
-    fb_var_screeninfo var_info;
-    if (ioctl(result->fd, FBIOGET_VSCREENINFO, &var_info) < 0)
+    for (int i = 0; i < borderCount; ++i)
     {
-        printf("FBIOGET_VSCREENINFO failed.\n");
-        abort();
+        gou_rect_t fill;
+        if (IntersectRect(borders[i], stale, &fill))
+        {
+            ClearScreen(display->ge2d, display->backgroundColor, fill.x, fill.y, fill.width, fill.height,
+                var_info.xres_virtual, var_info.yres_virtual, job.framebuffer);
+        }
     }
 
-    result->width = var_info.xres;
-    result->height = var_info.yres;
 
-    const int BUFFER_COUNT = var_info.yres_virtual / var_info.yres;
+    gou_rect_t dirty = covered;
+    for (int i = 0; i < job.layerCount; ++i)
+    {
+        gou_rect_t layerRect;
+        if (IntersectRect(FrameBufferRect(display, job.layers[i].dst), screen, &layerRect))
+        {
+            dirty = UnionRect(dirty, layerRect);
+        }
+    }
 
-    printf("gou_display_create: w=%d, h=%d, vx=%d, vy=%d (buffers=%d)\n",
-        var_info.xres, var_info.yres, var_info.xres_virtual, var_info.yres_virtual, BUFFER_COUNT);
+    state.valid = true;
+    state.backgroundColor = display->backgroundColor;
+    state.dirty = dirty;
+}
 
 
-    // buffers
-    for (int i = 0; i < BUFFER_COUNT; ++i)
+// Scales the source by the largest whole factor that fits the destination
+// into an intermediate surface, so the final bilinear pass only blends
+// the edges between enlarged pixels.
+static gou_surface_t* SharpPrescale(gou_display_t* display, int layerIndex, gou_surface_t* src, gou_rect_t* srcRect, const gou_rect_t& dst)
+{
+    const int scaleX = (srcRect->width > 0) ? dst.width / srcRect->width : 0;
+    const int scaleY = (srcRect->height > 0) ? dst.height / srcRect->height : 0;
+    if (scaleX < 1 || scaleY < 1 || (scaleX == 1 && scaleY == 1))
     {
-        //c4_surface_t* surface = c4_surface_create(result, result->width, result->height, DRM_FORMAT_XRGB8888);
-        int framebuffer = i * var_info.yres;
-
-        result->freeFrameBuffers->push(framebuffer);
+        return src;
     }
 
+    const int width = srcRect->width * scaleX;
+    const int height = srcRect->height * scaleY;
 
-    sem_init(&result->usedSem, 0, 0);
-    sem_init(&result->freeSem, 0, BUFFER_COUNT);
-
-    pthread_mutex_init(&result->queueMutex, NULL);
+    // Reused across frames while the content size is unchanged. A slot is
+    // only read by its own layer, and the previous frame's work completed
+    // with its final blocking blit, so no queued GE2D work can still use
+    // the surface being replaced.
+    gou_surface_t* intermediate = display->sharpSurfaces[layerIndex];
+    if (!intermediate ||
+        gou_surface_width_get(intermediate) != width || gou_surface_height_get(intermediate) != height)
+    {
+        if (intermediate)
+        {
+            gou_surface_destroy(intermediate);
+        }
 
-    pthread_create(&result->renderThread, NULL, RenderThread, result);
+        intermediate = gou_surface_create(display, width, height, DRM_FORMAT_ARGB8888);
+        display->sharpSurfaces[layerIndex] = intermediate;
 
-    return result;
-}
+        if (!intermediate)
+        {
+            printf("SharpPrescale: intermediate surface allocation failed.\n");
+            return src;
+        }
+    }
 
-void gou_display_destroy(gou_display_t* display)
-{
-    display->terminating = true;
-    sem_post(&display->usedSem);
+    Blit(display->ge2d, src, srcRect->x, srcRect->y, srcRect->width, srcRect->height, false, false,
+        intermediate, 0, 0, width, height, width, height, 0, GOU_ROTATION_DEGREES_0,
+        GOU_BLEND_MODE_NONE, 0xff, GOU_SCALE_FILTER_NEAREST, false);
 
-    pthread_join(display->renderThread, NULL);
+    srcRect->x = 0;
+    srcRect->y = 0;
+    srcRect->width = width;
+    srcRect->height = height;
 
-    close(display->fd);
+    return intermediate;
+}
 
-    delete display->freeFrameBuffers;
-    delete display->usedFrameBuffers;
+
+// Performs queued presents so the GE2D work never stalls the caller
+static void* BlitThread(void* arg)
+{
+    gou_display_t* obj = (gou_display_t*)arg;
+
+    fb_var_screeninfo var_info;
+    if (FbIoctl(obj, FBIOGET_VSCREENINFO, &var_info) < 0)
+    {
+        printf("FBIOGET_VSCREENINFO failed.\n");
+        abort();
+    }
+
+    while(true)
+    {
+        pthread_mutex_lock(&obj->jobMutex);
+
+        while (obj->jobs->empty() && !obj->blitTerminating && !obj->ge2dSyncRequested)
+        {
+            pthread_cond_wait(&obj->jobCond, &obj->jobMutex);
+        }
+
+        // A queued frame's final blit would finish the captures as well
+        if (obj->jobs->empty() && obj->ge2dSyncRequested)
+        {
+            obj->ge2dSyncRequested = false;
+            pthread_mutex_unlock(&obj->jobMutex);
+
+            SyncGe2d(obj);
+            continue;
+        }
+
+        if (obj->jobs->empty())
+        {
+            pthread_mutex_unlock(&obj->jobMutex);
+            break;
+        }
+
+        present_job_t job = obj->jobs->front();
+        obj->jobs->pop();
+
+        pthread_mutex_unlock(&obj->jobMutex);
+
+
+        gou_display_frame_timing_t& timing = obj->frameBufferTimings->at(job.framebuffer / obj->height);
+
+        if (job.direct)
+        {
+            // Nothing to composite, but the background must be cleared
+            // in full the next time the buffer is composited into
+            obj->frameBufferStates->at(job.framebuffer / obj->height).valid = false;
+
+            timing.ready_us = MicrosecondsGet();
+
+            pthread_mutex_lock(&obj->jobMutex);
+            obj->completedFence = job.fence;
+            pthread_cond_broadcast(&obj->fenceCond);
+            pthread_mutex_unlock(&obj->jobMutex);
+
+            gou_frame_queue_push(obj->usedFrameBuffers, job.framebuffer);
+            continue;
+        }
+
+        // Layers are composited bottom up over the background
+        const uint64_t clearStart = MicrosecondsGet();
+        ClearBackground(obj, job, var_info);
+
+        const uint64_t blitStart = MicrosecondsGet();
+        for (int i = 0; i < job.layerCount; ++i)
+        {
+            const gou_display_layer_t& layer = job.layers[i];
+            gou_surface_t* surface = job.staging[i] ? job.staging[i] : layer.surface;
+
+            // Only the last operation blocks; GE2D completes the rest in order before it
+            gou_scale_filter_t filter = (layer.filter != GOU_SCALE_FILTER_DEFAULT) ? layer.filter : obj->scaleFilter;
+            gou_rect_t src = layer.src;
+
+            if (filter == GOU_SCALE_FILTER_SHARP_BILINEAR)
+            {
+                surface = SharpPrescale(obj, i, surface, &src, layer.dst);
+                filter = GOU_SCALE_FILTER_BILINEAR;
+            }
+
+            Blit(obj->ge2d, surface, src.x, src.y, src.width, src.height, layer.mirror_x, layer.mirror_y,
+                NULL, layer.dst.y, obj->height - (layer.dst.x + layer.dst.width), layer.dst.width, layer.dst.height,
+                var_info.xres_virtual, var_info.yres_virtual, job.framebuffer, GOU_ROTATION_DEGREES_270,
+                layer.blend_mode, layer.alpha, filter, i == job.layerCount - 1);
+        }
+
+        timing.ready_us = MicrosecondsGet();
+        timing.clear_us = blitStart - clearStart;
+        timing.blit_us = timing.ready_us - blitStart;
+
+        for (int i = 0; i < job.layerCount; ++i)
+        {
+            if (job.staging[i])
+            {
+                gou_surface_pool_release(obj->stagingPool, job.staging[i]);
+            }
+        }
+
+
+        // The source surface may now be reused by the caller
+        pthread_mutex_lock(&obj->jobMutex);
+        obj->completedFence = job.fence;
+        pthread_cond_broadcast(&obj->fenceCond);
+        pthread_mutex_unlock(&obj->jobMutex);
+
+
+        gou_frame_queue_push(obj->usedFrameBuffers, job.framebuffer);
+    }
+
+
+    return NULL;
+}
+
+// Returns -1 if no framebuffer is available and block is false
+static int AcquireFrameBuffer(gou_display_t* display, bool block)
+{
+    int result;
+    if (gou_frame_queue_try_pop(display->freeFrameBuffers, &result))
+    {
+        return result;
+    }
+
+    // Mailbox replaces the oldest frame that has not been shown yet
+    if (display->presentMode == GOU_PRESENT_MODE_MAILBOX &&
+        gou_frame_queue_try_pop(display->usedFrameBuffers, &result))
+    {
+        pthread_mutex_lock(&display->statsMutex);
+        ++display->framesDropped;
+        pthread_mutex_unlock(&display->statsMutex);
+
+        return result;
+    }
+
+    if (!block)
+    {
+        return -1;
+    }
+
+    if (!gou_frame_queue_pop(display->freeFrameBuffers, &result))
+    {
+        printf("no framebuffer available.\n");
+        abort();
+    }
+
+    return result;
+}
+
+static bool FrameBufferAvailable(gou_display_t* display)
+{
+    return gou_frame_queue_size_get(display->freeFrameBuffers) > 0 ||
+        (display->presentMode == GOU_PRESENT_MODE_MAILBOX && gou_frame_queue_size_get(display->usedFrameBuffers) > 0);
+}
+
+static void ReleaseStaging(gou_display_t* display, present_job_t* job)
+{
+    for (int i = 0; i < job->layerCount; ++i)
+    {
+        if (job->staging[i])
+        {
+            gou_surface_pool_release(display->stagingPool, job->staging[i]);
+            job->staging[i] = NULL;
+        }
+    }
+}
+
+// Hands a job holding an acquired framebuffer to BlitThread
+static gou_display_fence_t SubmitJob(gou_display_t* display, present_job_t* job)
+{
+    gou_display_frame_timing_t& timing = display->frameBufferTimings->at(job->framebuffer / display->height);
+
+    const int shownPending = gou_frame_queue_size_get(display->usedFrameBuffers);
+
+    pthread_mutex_lock(&display->statsMutex);
+    ++display->framesPresented;
+    pthread_mutex_unlock(&display->statsMutex);
+
+    pthread_mutex_lock(&display->jobMutex);
+
+    job->fence = ++display->nextFence;
+    timing.fence = job->fence;
+    timing.queue_depth = (int)display->jobs->size() + shownPending;
+    display->jobs->push(*job);
+    pthread_cond_signal(&display->jobCond);
+
+    pthread_mutex_unlock(&display->jobMutex);
+
+    return job->fence;
+}
+
+static gou_display_fence_t QueuePresent(gou_display_t* display, const gou_display_layer_t* layers, int layerCount, bool block,
+            gou_present_result_t* outResult)
+{
+    // Failures are errors unless they are only for want of a framebuffer
+    *outResult = GOU_PRESENT_RESULT_ERROR;
+
+    const uint64_t presentStart = MicrosecondsGet();
+
+    if (layerCount < 1 || layerCount > GOU_DISPLAY_MAX_LAYERS)
+    {
+        printf("gou_display_present: invalid layer count (%d).\n", layerCount);
+        return GOU_DISPLAY_FENCE_NONE;
+    }
+
+    for (int i = 0; i < layerCount; ++i)
+    {
+        uint32_t format = gou_surface_format_get(layers[i].surface);
+        if (!gou_display_format_supported(format))
+        {
+            printf("gou_display_present: GE2D not supported (drm_fourcc=%c%c%c%c).\n",
+                format & 0xff, format >> 8 & 0xff, format >> 16 & 0xff, format >> 24);
+            return GOU_DISPLAY_FENCE_NONE;
+        }
+    }
+
+    // Avoid converting a frame that cannot be queued
+    if (!block && !FrameBufferAvailable(display))
+    {
+        *outResult = GOU_PRESENT_RESULT_BUSY;
+        return GOU_DISPLAY_FENCE_NONE;
+    }
+
+
+    present_job_t job;
+    memset(&job, 0, sizeof(job));
+
+    job.layerCount = layerCount;
+
+    for (int i = 0; i < layerCount; ++i)
+    {
+        const gou_display_layer_t& layer = layers[i];
+        job.layers[i] = layer;
+
+        // Formats GE2D cannot read are converted on the CPU first
+        if (gou_surface_format_info_get(layer.surface)->ge2d_format == 0)
+        {
+            job.staging[i] = ConvertToStaging(display, layer.surface,
+                layer.src.x, layer.src.y, layer.src.width, layer.src.height);
+            if (!job.staging[i])
+            {
+                ReleaseStaging(display, &job);
+                return GOU_DISPLAY_FENCE_NONE;
+            }
+        }
+    }
+
+
+    // Framebuffers are only ever returned by RenderThread so a frame
+    // that fails after this point cannot give its buffer back.
+    const uint64_t waitStart = MicrosecondsGet();
+
+    job.framebuffer = AcquireFrameBuffer(display, block);
+    if (job.framebuffer < 0)
+    {
+        ReleaseStaging(display, &job);
+
+        *outResult = GOU_PRESENT_RESULT_BUSY;
+        return GOU_DISPLAY_FENCE_NONE;
+    }
+
+    gou_display_frame_timing_t& timing = display->frameBufferTimings->at(job.framebuffer / display->height);
+    memset(&timing, 0, sizeof(timing));
+    timing.present_us = presentStart;
+    timing.free_wait_us = MicrosecondsGet() - waitStart;
+
+    *outResult = GOU_PRESENT_RESULT_QUEUED;
+    return SubmitJob(display, &job);
+}
+
+
+static void SingleLayer(gou_display_layer_t* layer, gou_surface_t* surface,
+            int srcX, int srcY, int srcWidth, int srcHeight, bool mirrorX, bool mirrorY,
+            int dstX, int dstY, int dstWidth, int dstHeight)
+{
+    layer->surface = surface;
+    layer->src.x = srcX;
+    layer->src.y = srcY;
+    layer->src.width = srcWidth;
+    layer->src.height = srcHeight;
+    layer->dst.x = dstX;
+    layer->dst.y = dstY;
+    layer->dst.width = dstWidth;
+    layer->dst.height = dstHeight;
+    layer->mirror_x = mirrorX;
+    layer->mirror_y = mirrorY;
+    layer->alpha = 0xff;
+    layer->blend_mode = GOU_BLEND_MODE_NONE;
+    layer->filter = GOU_SCALE_FILTER_DEFAULT;
+}
+
+
+// pixclock is the pixel period in picoseconds
+static uint64_t RefreshPeriodGet(const fb_var_screeninfo& var_info)
+{
+    const uint64_t htotal = var_info.xres + var_info.left_margin + var_info.right_margin + var_info.hsync_len;
+    const uint64_t vtotal = var_info.yres + var_info.upper_margin + var_info.lower_margin + var_info.vsync_len;
+
+    const uint64_t result = (uint64_t)var_info.pixclock * htotal * vtotal / 1000000;
+    if (result == 0)
+    {
+        return 1000000 / 60;
+    }
+
+    return result;
+}
+
+static void RecordFlip(gou_display_t* display, int framebuffer, gou_present_mode_t presentMode,
+            uint64_t vblankPeriod, uint64_t* prevFlip)
+{
+    gou_display_frame_timing_t timing = display->frameBufferTimings->at(framebuffer / display->height);
+
+    timing.flip_us = MicrosecondsGet();
+    timing.flip_interval_us = (*prevFlip != 0) ? timing.flip_us - *prevFlip : 0;
+
+    // A frame should flip on the first vblank after it was both ready
+    // and the previous flip completed
+    if (presentMode != GOU_PRESENT_MODE_IMMEDIATE && *prevFlip != 0)
+    {
+        const uint64_t due = (timing.ready_us > *prevFlip) ? timing.ready_us : *prevFlip;
+        if (timing.flip_us > due)
+        {
+            const uint64_t vblanks = (timing.flip_us - due + vblankPeriod / 2) / vblankPeriod;
+            timing.missed_vblanks = (vblanks > 1) ? (int)(vblanks - 1) : 0;
+        }
+    }
+
+    *prevFlip = timing.flip_us;
+
+
+    pthread_mutex_lock(&display->statsMutex);
+
+    ++display->framesShown;
+    display->missedVBlanks += timing.missed_vblanks;
+
+    if ((int)display->timingHistory->size() < GOU_DISPLAY_STATS_HISTORY)
+    {
+        display->timingHistory->push_back(timing);
+    }
+    else
+    {
+        display->timingHistory->at(display->timingHistoryNext) = timing;
+    }
+
+    display->timingHistoryNext = (display->timingHistoryNext + 1) % GOU_DISPLAY_STATS_HISTORY;
+
+    pthread_mutex_unlock(&display->statsMutex);
+}
+
+
+// Wraps a flip buffer as a surface, exporting it on first use. Must be
+// called with the scanout mutex held.
+static gou_surface_t* ScanoutSurfaceGet(gou_display_t* display, int index)
+{
+    if ((size_t)index < display->scanoutSurfaces->size() && (*display->scanoutSurfaces)[index])
+    {
+        return (*display->scanoutSurfaces)[index];
+    }
+
+    fb_fix_screeninfo fix_info;
+    if (FbIoctl(display, FBIOGET_FSCREENINFO, &fix_info) < 0)
+    {
+        printf("FBIOGET_FSCREENINFO failed.\n");
+        return NULL;
+    }
+
+    fb_dmabuf_export dmaexp;
+    memset(&dmaexp, 0, sizeof(dmaexp));
+    dmaexp.buffer_idx = index;
+    dmaexp.flags = O_CLOEXEC | O_RDWR;
+
+    if (FbIoctl(display, FBIOGET_OSD_DMABUF, &dmaexp) < 0)
+    {
+        printf("FBIOGET_OSD_DMABUF failed.\n");
+        return NULL;
+    }
+
+    // Locate the buffer whether all of the memory or only it was exported
+    const size_t bufferSize = (size_t)fix_info.line_length * display->height;
+    const off_t size = lseek(dmaexp.fd, 0, SEEK_END);
+    const int offset = (size >= (off_t)(bufferSize * (index + 1))) ? (int)(bufferSize * index) : 0;
+
+    gou_surface_t* result = gou_surface_import_fd(display, dmaexp.fd, display->width, display->height,
+        DRM_FORMAT_XRGB8888, fix_info.line_length, offset);
+
+    close(dmaexp.fd);
+
+    if (display->scanoutSurfaces->size() <= (size_t)index)
+    {
+        display->scanoutSurfaces->resize(index + 1, NULL);
+    }
+
+    (*display->scanoutSurfaces)[index] = result;
+
+    return result;
+}
+
+// Queues a copy of the frame just flipped into the recorder's ring. Must be
+// called with the scanout mutex held. The copy is queued ahead of any blit
+// into this buffer, which is only recycled after the next flip.
+static void RecordFrame(gou_display_t* display, int framebuffer)
+{
+    gou_surface_t* scanout = ScanoutSurfaceGet(display, framebuffer / display->height);
+    if (!scanout)
+    {
+        return;
+    }
+
+    const int slot = gou_recorder_acquire(display->recorder);
+    if (slot < 0)
+    {
+        return;
+    }
+
+    gou_surface_t* frame = gou_recorder_surface_get(display->recorder, slot);
+    const int width = gou_recorder_width_get(display->recorder);
+    const int height = gou_recorder_height_get(display->recorder);
+
+    const bool scaled = (width != display->height || height != display->width);
+
+    // Rotates the panel back to the orientation frames are presented in
+    Blit(display->ge2d, scanout, 0, 0, display->width, display->height, false, false,
+        frame, 0, 0, height, width, width, height, 0, GOU_ROTATION_DEGREES_90,
+        GOU_BLEND_MODE_NONE, 0xff, scaled ? GOU_SCALE_FILTER_BILINEAR : GOU_SCALE_FILTER_DEFAULT, false);
+
+    gou_recorder_submit(display->recorder, slot, Ge2dQueuedGet(display->ge2d));
+}
+
+static void* RenderThread(void* arg)
+{
+    gou_display_t* obj = (gou_display_t*)arg;
+
+    int prevFrameBuffer = -1;
+
+
+    fb_var_screeninfo var_info;
+    if (FbIoctl(obj, FBIOGET_VSCREENINFO, &var_info) < 0)
+    {
+        printf("FBIOGET_VSCREENINFO failed.\n");
+        abort();
+    }
+
+    const int buffer_count = var_info.yres_virtual / var_info.yres;
+    printf("RenderThread: buffer_count=%d\n", buffer_count);
+
+    const uint64_t vblankPeriod = RefreshPeriodGet(var_info);
+    uint64_t prevFlip = 0;
+
+    int current_buffer = 0;
+
+    while(true)
+    {
+        int framebuffer;
+        if (!gou_frame_queue_pop(obj->usedFrameBuffers, &framebuffer)) break;
+
+        // Only the newest frame is shown, older ones are recycled
+        const gou_present_mode_t presentMode = obj->presentMode;
+        if (presentMode != GOU_PRESENT_MODE_FIFO)
+        {
+            int newer;
+            while (gou_frame_queue_try_pop(obj->usedFrameBuffers, &newer))
+            {
+                gou_frame_queue_push(obj->freeFrameBuffers, framebuffer);
+                framebuffer = newer;
+
+                pthread_mutex_lock(&obj->statsMutex);
+                ++obj->framesDropped;
+                pthread_mutex_unlock(&obj->statsMutex);
+            }
+        }
+
+
+ 
+
+        // Swap buffers
+        var_info.yoffset = framebuffer;
+        if (presentMode == GOU_PRESENT_MODE_IMMEDIATE)
+        {
+            // Takes effect without waiting for vblank
+            if (FbIoctl(obj, FBIOPAN_DISPLAY, &var_info) < 0)
+            {
+                printf("FBIOPAN_DISPLAY failed.\n");
+                abort();
+            }
+        }
+        else
+        {
+            // Latches on vblank
+            if (FbIoctl(obj, FBIOPUT_VSCREENINFO, &var_info) < 0) 
+            {
+                printf("FBIOPUT_VSCREENINFO failed.\n");
+                abort();
+            }
+        }
+
+        RecordFlip(obj, framebuffer, presentMode, vblankPeriod, &prevFlip);
+
+        ++current_buffer;
+        current_buffer %= buffer_count;
+
+        //printf("FbDevDisplay: frame - current_buffer=%d\n", current_buffer);
+        
+        // Held only after the flip so captures never wait out a vblank. A
+        // capture of the previous buffer finishes before it is reused.
+        pthread_mutex_lock(&obj->scanoutMutex);
+
+        obj->visibleFrameBuffer = framebuffer;
+
+        if (prevFrameBuffer >= 0)
+        {
+            gou_frame_queue_push(obj->freeFrameBuffers, prevFrameBuffer);
+        }
+
+        if (obj->recorder)
+        {
+            RecordFrame(obj, framebuffer);
+        }
+
+        pthread_mutex_unlock(&obj->scanoutMutex);
+
+        prevFrameBuffer = framebuffer;            
+    }
+
+
+    return NULL;
+}
+
+
+// Tries the requested count first, then fewer buffers, and finally
+// leaves the driver configuration unchanged.
+static void NegotiateBufferCount(gou_display_t* display, int requested)
+{
+    fb_var_screeninfo var_info;
+    if (FbIoctl(display, FBIOGET_VSCREENINFO, &var_info) < 0)
+    {
+        printf("FBIOGET_VSCREENINFO failed.\n");
+        abort();
+    }
+
+    fb_fix_screeninfo fix_info;
+    if (FbIoctl(display, FBIOGET_FSCREENINFO, &fix_info) < 0)
+    {
+        printf("FBIOGET_FSCREENINFO failed.\n");
+        abort();
+    }
+
+    // One buffer is always on screen so at least two are needed
+    if (requested < 2)
+    {
+        requested = 2;
+    }
+
+    const int current = var_info.yres_virtual / var_info.yres;
+    if (requested == current)
+    {
+        return;
+    }
+
+    // The flip buffers must fit in the framebuffer memory
+    int maximum = requested;
+    if (fix_info.line_length > 0)
+    {
+        maximum = fix_info.smem_len / (fix_info.line_length * var_info.yres);
+    }
+
+    const int lowest = (requested < current) ? requested : current + 1;
+    for (int count = (requested < maximum) ? requested : maximum; count >= lowest; --count)
+    {
+        fb_var_screeninfo request = var_info;
+        request.yres_virtual = var_info.yres * count;
+        request.yoffset = 0;
+
+        if (FbIoctl(display, FBIOPUT_VSCREENINFO, &request) == 0)
+        {
+            // The layout is device wide, so it is put back on destroy
+            display->originalVarInfo = var_info;
+            display->restoreVarInfo = true;
+            return;
+        }
+
+        printf("NegotiateBufferCount: %d buffers rejected (errno=%d).\n", count, errno);
+    }
+}
+
+// Points the software GE2D at the framebuffer memory addressed as OSD0
+static void AttachSoftGe2d(gou_display_t* display)
+{
+    fb_var_screeninfo var_info;
+    if (FbIoctl(display, FBIOGET_VSCREENINFO, &var_info) < 0)
+    {
+        printf("FBIOGET_VSCREENINFO failed.\n");
+        abort();
+    }
+
+    fb_fix_screeninfo fix_info;
+    if (FbIoctl(display, FBIOGET_FSCREENINFO, &fix_info) < 0 || fix_info.line_length == 0)
+    {
+        printf("FBIOGET_FSCREENINFO failed.\n");
+        abort();
+    }
+
+    void* pixels;
+    if (display->virtualFb)
+    {
+        pixels = gou_virtual_fb_map_get(display->virtualFb);
+    }
+    else
+    {
+        pixels = mmap(NULL, fix_info.smem_len, PROT_READ | PROT_WRITE, MAP_SHARED, display->fd, 0);
+        if (pixels == MAP_FAILED)
+        {
+            printf("AttachSoftGe2d: mmap /dev/fb0 failed.\n");
+            abort();
+        }
+
+        display->fbMap = pixels;
+        display->fbMapSize = fix_info.smem_len;
+    }
+
+    gou_soft_ge2d_osd_set(display->ge2d->soft, pixels, fix_info.line_length,
+        var_info.xres_virtual, fix_info.smem_len / fix_info.line_length);
+}
+
+gou_display_t* gou_display_create()
+{
+    return gou_display_create_ex(NULL);
+}
+
+gou_display_t* gou_display_create_ex(const gou_display_options_t* options)
+{
+    // GOU_DISPLAY=virtual runs unmodified applications headless
+    const char* env = getenv("GOU_DISPLAY");
+    const bool headless = (options && options->virtual_display) || (env && strcmp(env, "virtual") == 0);
+
+    gou_display_t* result = (gou_display_t*)malloc(sizeof(gou_display_t));
+    if (!result)
+    {
+        printf("malloc failed.\n");
+        abort();
+    }
+
+    memset(result, 0, sizeof(*result));
+
+    
+    result->backgroundColor = (0xff000000);
+    result->presentMode = options ? options->present_mode : GOU_PRESENT_MODE_FIFO;
+    result->jobs = new std::queue<present_job_t>;
+    result->frameBufferStates = new std::vector<framebuffer_state_t>;
+    result->frameBufferTimings = new std::vector<gou_display_frame_timing_t>;
+    result->timingHistory = new std::vector<gou_display_frame_timing_t>;
+    result->scanoutSurfaces = new std::vector<gou_surface_t*>;
+    result->scanoutAcquired = new std::vector<bool>;
+    result->visibleFrameBuffer = -1;
+
+
+    if (headless)
+    {
+        const bool sized = options && options->virtual_width > 0 && options->virtual_height > 0;
+
+        result->fd = -1;
+        result->virtualFb = gou_virtual_fb_create(
+            sized ? options->virtual_width : VIRTUAL_DEFAULT_WIDTH,
+            sized ? options->virtual_height : VIRTUAL_DEFAULT_HEIGHT,
+            VIRTUAL_MAX_BUFFERS,
+            (options && options->virtual_refresh_rate > 0) ? options->virtual_refresh_rate : VIRTUAL_DEFAULT_REFRESH_RATE);
+    }
+    else
+    {
+        // Open device
+        result->fd = open("/dev/fb0", O_RDWR);
+        if (result->fd < 0)
+        {
+            printf("open /dev/fb0 failed.\n");
+            abort();
+        }
+    }
+
+
+    // GOU_GE2D=soft renders on the CPU even when the 2D engine is present
+    const char* ge2dEnv = getenv("GOU_GE2D");
+    bool soft = headless || (ge2dEnv && strcmp(ge2dEnv, "soft") == 0);
+
+    if (!soft && ge2d_device.fd < 0)
+    {
+        ge2d_device.fd = open("/dev/ge2d", O_RDWR);
+        if (ge2d_device.fd < 0)
+        {
+            printf("open /dev/ge2d failed, using the software engine.\n");
+            soft = true;
+        }
+    }
+
+    if (soft)
+    {
+        result->ge2d = (ge2d_state_t*)malloc(sizeof(ge2d_state_t));
+        if (!result->ge2d)
+        {
+            printf("malloc failed.\n");
+            abort();
+        }
+
+        memset(result->ge2d, 0, sizeof(*result->ge2d));
+        result->ge2d->fd = -1;
+        result->ge2d->soft = gou_soft_ge2d_create();
+        result->ge2d->scaleCoef = FILTER_TYPE_BILINEAR;
+        pthread_mutex_init(&result->ge2d->mutex, NULL);
+        pthread_cond_init(&result->ge2d->completedCond, NULL);
+    }
+    else
+    {
+        result->ge2d = &ge2d_device;
+    }
+
+ 
+    if (options && options->buffer_count > 0)
+    {
+        NegotiateBufferCount(result, options->buffer_count);
+    }
+
+    if (result->ge2d->soft)
+    {
+        AttachSoftGe2d(result);
+    }
+
+
+    // Properties
+    fb_var_screeninfo var_info;
+    if (FbIoctl(result, FBIOGET_VSCREENINFO, &var_info) < 0)
+    {
+        printf("FBIOGET_VSCREENINFO failed.\n");
+        abort();
+    }
+
+    result->width = var_info.xres;
+    result->height = var_info.yres;
+
+    const int BUFFER_COUNT = var_info.yres_virtual / var_info.yres;
+    result->bufferCount = BUFFER_COUNT;
+
+    printf("gou_display_create: w=%d, h=%d, vx=%d, vy=%d (buffers=%d)\n",
+        var_info.xres, var_info.yres, var_info.xres_virtual, var_info.yres_virtual, BUFFER_COUNT);
+
+
+    // buffers
+    result->freeFrameBuffers = gou_frame_queue_create(BUFFER_COUNT);
+    result->usedFrameBuffers = gou_frame_queue_create(BUFFER_COUNT);
+
+    for (int i = 0; i < BUFFER_COUNT; ++i)
+    {
+        //c4_surface_t* surface = c4_surface_create(result, result->width, result->height, DRM_FORMAT_XRGB8888);
+        int framebuffer = i * var_info.yres;
+
+        gou_frame_queue_push(result->freeFrameBuffers, framebuffer);
+    }
+
+    // Flip buffer contents are unknown until first cleared
+    result->frameBufferStates->resize(BUFFER_COUNT);
+    result->frameBufferTimings->resize(BUFFER_COUNT);
+    result->scanoutAcquired->resize(BUFFER_COUNT, false);
+
+
+
+    pthread_mutex_init(&result->statsMutex, NULL);
+    pthread_mutex_init(&result->scanoutMutex, NULL);
+
+    pthread_mutex_init(&result->jobMutex, NULL);
+    pthread_cond_init(&result->jobCond, NULL);
+    pthread_cond_init(&result->fenceCond, NULL);
+
+    if (!result->ge2d->soft)
+    {
+        result->ge2dSyncSurface = gou_surface_create(result, 1, 1, DRM_FORMAT_XRGB8888);
+        if (!result->ge2dSyncSurface)
+        {
+            printf("gou_display_create: GE2D sync surface allocation failed.\n");
+            abort();
+        }
+    }
+
+    pthread_create(&result->renderThread, NULL, RenderThread, result);
+    pthread_create(&result->blitThread, NULL, BlitThread, result);
+
+    return result;
+}
+
+void gou_display_destroy(gou_display_t* display)
+{
+    // Finish queued presents before stopping the flip thread
+    pthread_mutex_lock(&display->jobMutex);
+    display->blitTerminating = true;
+    pthread_cond_signal(&display->jobCond);
+    pthread_mutex_unlock(&display->jobMutex);
+
+    pthread_join(display->blitThread, NULL);
+
+    gou_frame_queue_close(display->usedFrameBuffers);
+
+    pthread_join(display->renderThread, NULL);
+
+    // Releases writers still waiting for their captures
+    if (display->ge2dSyncSurface)
+    {
+        SyncGe2d(display);
+    }
+
+    if (display->recorder)
+    {
+        gou_recorder_destroy(display->recorder, NULL);
+    }
+
+    // Pending screenshots return their surfaces to the pool
+    if (display->screenshotWriter)
+    {
+        gou_screenshot_writer_destroy(display->screenshotWriter);
+        gou_surface_pool_destroy(display->screenshotPool);
+    }
+
+    if (display->ge2dSyncSurface)
+    {
+        gou_surface_destroy(display->ge2dSyncSurface);
+    }
+
+    for (size_t i = 0; i < display->scanoutSurfaces->size(); ++i)
+    {
+        if ((*display->scanoutSurfaces)[i])
+        {
+            gou_surface_destroy((*display->scanoutSurfaces)[i]);
+        }
+    }
+
+    if (display->fbMap)
+    {
+        munmap(display->fbMap, display->fbMapSize);
+    }
+
+    // Later clients of the framebuffer expect the driver's layout
+    if (display->restoreVarInfo && FbIoctl(display, FBIOPUT_VSCREENINFO, &display->originalVarInfo) < 0)
+    {
+        printf("gou_display_destroy: restoring the framebuffer layout failed (errno=%d).\n", errno);
+    }
+
+    if (display->virtualFb)
+    {
+        gou_virtual_fb_destroy(display->virtualFb);
+    }
+    else
+    {
+        close(display->fd);
+    }
+
+    if (display->stagingPool)
+    {
+        gou_surface_pool_destroy(display->stagingPool);
+    }
+
+    for (int i = 0; i < GOU_DISPLAY_MAX_LAYERS; ++i)
+    {
+        if (display->sharpSurfaces[i])
+        {
+            gou_surface_destroy(display->sharpSurfaces[i]);
+        }
+    }
+
+    if (display->ge2d != &ge2d_device)
+    {
+        gou_soft_ge2d_destroy(display->ge2d->soft);
+        pthread_mutex_destroy(&display->ge2d->mutex);
+        pthread_cond_destroy(&display->ge2d->completedCond);
+        free(display->ge2d);
+    }
+
+    pthread_cond_destroy(&display->fenceCond);
+    pthread_cond_destroy(&display->jobCond);
+    pthread_mutex_destroy(&display->jobMutex);
+    pthread_mutex_destroy(&display->statsMutex);
+    pthread_mutex_destroy(&display->scanoutMutex);
+
+    delete display->jobs;
+    delete display->frameBufferStates;
+    delete display->frameBufferTimings;
+    delete display->timingHistory;
+    delete display->scanoutSurfaces;
+    delete display->scanoutAcquired;
+    gou_frame_queue_destroy(display->freeFrameBuffers);
+    gou_frame_queue_destroy(display->usedFrameBuffers);
 
     free(display);
 }
@@ -489,57 +1785,161 @@ void gou_display_present(gou_display_t* display, gou_surface_t* surface,
             int srcX, int srcY, int srcWidth, int srcHeight, bool mirrorX, bool mirrorY,
             int dstX, int dstY, int dstWidth, int dstHeight)
 {
-    sem_wait(&display->freeSem);
+    gou_display_layer_t layer;
+    SingleLayer(&layer, surface, srcX, srcY, srcWidth, srcHeight, mirrorX, mirrorY,
+        dstX, dstY, dstWidth, dstHeight);
+
+    gou_display_present_layers(display, &layer, 1);
+}
+
+gou_display_fence_t gou_display_present_async(gou_display_t* display, gou_surface_t* surface,
+            int srcX, int srcY, int srcWidth, int srcHeight, bool mirrorX, bool mirrorY,
+            int dstX, int dstY, int dstWidth, int dstHeight)
+{
+    gou_display_layer_t layer;
+    SingleLayer(&layer, surface, srcX, srcY, srcWidth, srcHeight, mirrorX, mirrorY,
+        dstX, dstY, dstWidth, dstHeight);
+
+    gou_present_result_t result;
+    return QueuePresent(display, &layer, 1, true, &result);
+}
 
+gou_display_fence_t gou_display_present_try(gou_display_t* display, gou_surface_t* surface,
+            int srcX, int srcY, int srcWidth, int srcHeight, bool mirrorX, bool mirrorY,
+            int dstX, int dstY, int dstWidth, int dstHeight, gou_present_result_t* outResult)
+{
+    gou_display_layer_t layer;
+    SingleLayer(&layer, surface, srcX, srcY, srcWidth, srcHeight, mirrorX, mirrorY,
+        dstX, dstY, dstWidth, dstHeight);
 
-    pthread_mutex_lock(&display->queueMutex);
+    gou_present_result_t result;
+    gou_display_fence_t fence = QueuePresent(display, &layer, 1, false, &result);
 
-    if (display->freeFrameBuffers->size() < 1)
+    if (outResult)
     {
-        printf("no framebuffer available.\n");
-        abort();
+        *outResult = result;
     }
 
-    int dstFrameBuffer = display->freeFrameBuffers->front();
-    display->freeFrameBuffers->pop();
+    return fence;
+}
 
-    pthread_mutex_unlock(&display->queueMutex);
+void gou_display_present_layers(gou_display_t* display, const gou_display_layer_t* layers, int count)
+{
+    gou_present_result_t result;
+    gou_display_fence_t fence = QueuePresent(display, layers, count, true, &result);
+    if (fence == GOU_DISPLAY_FENCE_NONE)
+    {
+        return;
+    }
 
+    gou_display_fence_wait(display, fence);
 
-    fb_var_screeninfo var_info;
-    if (ioctl(display->fd, FBIOGET_VSCREENINFO, &var_info) < 0)
+    // The blit has completed so transient surfaces can be recycled
+    if (display->frameArena)
     {
-        printf("FBIOGET_VSCREENINFO failed.\n");
+        gou_frame_arena_reset(display->frameArena);
+    }
+}
+
+gou_display_fence_t gou_display_present_layers_async(gou_display_t* display, const gou_display_layer_t* layers, int count)
+{
+    gou_present_result_t result;
+    return QueuePresent(display, layers, count, true, &result);
+}
+
+gou_surface_t* gou_display_scanout_acquire(gou_display_t* display)
+{
+    // Check the driver can export before taking a framebuffer, which
+    // cannot be given back
+    pthread_mutex_lock(&display->scanoutMutex);
+    const bool exported = (ScanoutSurfaceGet(display, 0) != NULL);
+    pthread_mutex_unlock(&display->scanoutMutex);
+
+    if (!exported)
+    {
+        return NULL;
+    }
+
+    const uint64_t waitStart = MicrosecondsGet();
+    const int framebuffer = AcquireFrameBuffer(display, true);
+
+    pthread_mutex_lock(&display->scanoutMutex);
+    gou_surface_t* result = ScanoutSurfaceGet(display, framebuffer / display->height);
+    display->scanoutAcquired->at(framebuffer / display->height) = true;
+    pthread_mutex_unlock(&display->scanoutMutex);
+
+    if (!result)
+    {
+        printf("gou_display_scanout_acquire: framebuffer %d could not be exported.\n", framebuffer / display->height);
         abort();
     }
 
-    //printf("yres_virtual=%d, offset=%d\n", var_info.yres_virtual, dstFrameBuffer.offset);
+    gou_display_frame_timing_t& timing = display->frameBufferTimings->at(framebuffer / display->height);
+    memset(&timing, 0, sizeof(timing));
+    timing.free_wait_us = MicrosecondsGet() - waitStart;
 
-    if (dstX != 0 || dstY != 0 ||
-        dstWidth != display->width || dstHeight != display->height)
+    return result;
+}
+
+gou_display_fence_t gou_display_scanout_present(gou_display_t* display, gou_surface_t* surface)
+{
+    int index = -1;
+
+    // Only a buffer taken from the free queue may be flipped to; any other
+    // could be visible or being composited into
+    pthread_mutex_lock(&display->scanoutMutex);
+    for (size_t i = 0; i < display->scanoutSurfaces->size(); ++i)
+    {
+        if ((*display->scanoutSurfaces)[i] == surface && display->scanoutAcquired->at(i))
+        {
+            display->scanoutAcquired->at(i) = false;
+            index = (int)i;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&display->scanoutMutex);
+
+    if (index < 0)
     {
-        ClearScreen(display->backgroundColor, var_info.xres, var_info.yres, var_info.xres_virtual, var_info.yres_virtual, dstFrameBuffer);
+        printf("gou_display_scanout_present: not an acquired scanout surface.\n");
+        return GOU_DISPLAY_FENCE_NONE;
     }
 
-    // Blit(surface, srcX, srcY, srcWidth, srcHeight, mirrorX, mirrorY,
-    //     dstX, dstY, dstWidth, dstHeight,
-    //     var_info.xres_virtual, var_info.yres_virtual, dstFrameBuffer, GOU_ROTATION_DEGREES_270);
+    present_job_t job;
+    memset(&job, 0, sizeof(job));
+
+    job.framebuffer = index * display->height;
+    job.direct = true;
 
-    // Blit(surface, srcX, srcY, srcWidth, srcHeight, mirrorX, mirrorY,
-    //     dstY, dstX, dstHeight, dstWidth,
-    //     var_info.xres_virtual, var_info.yres_virtual, dstFrameBuffer, GOU_ROTATION_DEGREES_270);
+    display->frameBufferTimings->at(index).present_us = MicrosecondsGet();
+
+    return SubmitJob(display, &job);
+}
+
+bool gou_display_fence_signaled(gou_display_t* display, gou_display_fence_t fence)
+{
+    pthread_mutex_lock(&display->jobMutex);
+    bool result = (display->completedFence >= fence);
+    pthread_mutex_unlock(&display->jobMutex);
 
-    Blit(surface, srcX, srcY, srcWidth, srcHeight, mirrorX, mirrorY,
-        dstY, display->height - (dstX + dstWidth), dstWidth, dstHeight,
-        var_info.xres_virtual, var_info.yres_virtual, dstFrameBuffer, GOU_ROTATION_DEGREES_270);
+    return result;
+}
 
+void gou_display_fence_wait(gou_display_t* display, gou_display_fence_t fence)
+{
+    pthread_mutex_lock(&display->jobMutex);
 
+    while (display->completedFence < fence)
+    {
+        pthread_cond_wait(&display->fenceCond, &display->jobMutex);
+    }
 
-    pthread_mutex_lock(&display->queueMutex);
-    display->usedFrameBuffers->push(dstFrameBuffer);
-    pthread_mutex_unlock(&display->queueMutex);
+    pthread_mutex_unlock(&display->jobMutex);
+}
 
-    sem_post(&display->usedSem);       
+int gou_display_buffer_count_get(gou_display_t* display)
+{
+    return display->bufferCount;
 }
 
 uint32_t gou_display_background_color_get(gou_display_t* display)
@@ -552,3 +1952,302 @@ void gou_display_background_color_set(gou_display_t* display, uint32_t value)
     display->backgroundColor = value;
 }
 
+gou_present_mode_t gou_display_present_mode_get(gou_display_t* display)
+{
+    return display->presentMode;
+}
+
+void gou_display_present_mode_set(gou_display_t* display, gou_present_mode_t value)
+{
+    display->presentMode = value;
+}
+
+gou_scale_filter_t gou_display_scale_filter_get(gou_display_t* display)
+{
+    return display->scaleFilter;
+}
+
+void gou_display_scale_filter_set(gou_display_t* display, gou_scale_filter_t value)
+{
+    display->scaleFilter = value;
+}
+
+gou_frame_arena_t* gou_display_frame_arena_get(gou_display_t* display)
+{
+    return display->frameArena;
+}
+
+void gou_display_frame_arena_set(gou_display_t* display, gou_frame_arena_t* value)
+{
+    display->frameArena = value;
+}
+
+bool gou_display_format_supported(uint32_t format)
+{
+    const gou_format_info_t* info = gou_format_info_get(format);
+
+    return info && (info->ge2d_format != 0 || gou_convert_supported(info));
+}
+
+void gou_display_ge2d_stats_get(gou_display_t* display, gou_display_ge2d_stats_t* outStats)
+{
+    ge2d_state_t* state = display->ge2d;
+
+    pthread_mutex_lock(&state->mutex);
+
+    outStats->config_hits = state->configHits;
+    outStats->config_misses = state->configMisses;
+
+    pthread_mutex_unlock(&state->mutex);
+}
+
+static gou_display_percentiles_t Percentiles(std::vector<uint64_t>& values)
+{
+    gou_display_percentiles_t result = { 0 };
+    if (values.empty())
+    {
+        return result;
+    }
+
+    std::sort(values.begin(), values.end());
+
+    const size_t last = values.size() - 1;
+    result.p50 = values[last * 50 / 100];
+    result.p90 = values[last * 90 / 100];
+    result.p99 = values[last * 99 / 100];
+    result.max = values[last];
+
+    return result;
+}
+
+void gou_display_stats_get(gou_display_t* display, gou_display_stats_t* outStats)
+{
+    memset(outStats, 0, sizeof(*outStats));
+
+    pthread_mutex_lock(&display->statsMutex);
+
+    outStats->frames_presented = display->framesPresented;
+    outStats->frames_shown = display->framesShown;
+    outStats->frames_dropped = display->framesDropped;
+    outStats->missed_vblanks = display->missedVBlanks;
+
+    std::vector<gou_display_frame_timing_t> history(*display->timingHistory);
+    if (!history.empty())
+    {
+        const int newest = (display->timingHistoryNext + GOU_DISPLAY_STATS_HISTORY - 1) % GOU_DISPLAY_STATS_HISTORY;
+        outStats->last = history.at(newest);
+    }
+
+    pthread_mutex_unlock(&display->statsMutex);
+
+
+    std::vector<uint64_t> freeWait;
+    std::vector<uint64_t> clear;
+    std::vector<uint64_t> blit;
+    std::vector<uint64_t> latency;
+    std::vector<uint64_t> flipInterval;
+
+    for (size_t i = 0; i < history.size(); ++i)
+    {
+        const gou_display_frame_timing_t& timing = history[i];
+
+        freeWait.push_back(timing.free_wait_us);
+        clear.push_back(timing.clear_us);
+        blit.push_back(timing.blit_us);
+        latency.push_back(timing.flip_us - timing.present_us);
+
+        if (timing.flip_interval_us != 0)
+        {
+            flipInterval.push_back(timing.flip_interval_us);
+        }
+    }
+
+    outStats->free_wait = Percentiles(freeWait);
+    outStats->clear = Percentiles(clear);
+    outStats->blit = Percentiles(blit);
+    outStats->latency = Percentiles(latency);
+    outStats->flip_interval = Percentiles(flipInterval);
+}
+
+void gou_display_stats_reset(gou_display_t* display)
+{
+    pthread_mutex_lock(&display->statsMutex);
+
+    display->framesPresented = 0;
+    display->framesShown = 0;
+    display->framesDropped = 0;
+    display->missedVBlanks = 0;
+    display->timingHistory->clear();
+    display->timingHistoryNext = 0;
+
+    pthread_mutex_unlock(&display->statsMutex);
+}
+
+bool gou_display_screenshot(gou_display_t* display, const char* filename)
+{
+    pthread_mutex_lock(&display->scanoutMutex);
+
+    if (display->visibleFrameBuffer < 0)
+    {
+        pthread_mutex_unlock(&display->scanoutMutex);
+
+        printf("gou_display_screenshot: no frame has been shown.\n");
+        return false;
+    }
+
+    gou_surface_t* scanout = ScanoutSurfaceGet(display, display->visibleFrameBuffer / display->height);
+    if (!scanout)
+    {
+        pthread_mutex_unlock(&display->scanoutMutex);
+        return false;
+    }
+
+    if (!display->screenshotWriter)
+    {
+        display->screenshotPool = gou_surface_pool_create(display, SCREENSHOT_POOL_BUDGET);
+        display->screenshotWriter = gou_screenshot_writer_create(SCREENSHOT_MAX_PENDING, display, WaitGe2d);
+    }
+
+    // R, G, B, X byte order is what libpng reads
+    gou_surface_t* capture = gou_surface_pool_acquire(display->screenshotPool,
+        display->height, display->width, DRM_FORMAT_XBGR8888);
+    if (!capture)
+    {
+        pthread_mutex_unlock(&display->scanoutMutex);
+
+        printf("gou_display_screenshot: capture surface allocation failed.\n");
+        return false;
+    }
+
+    // Rotates the panel back to the orientation frames are presented in. The
+    // copy is queued ahead of any blit into the visible buffer, which is only
+    // recycled after the next flip; the writer waits for it before reading.
+    Blit(display->ge2d, scanout, 0, 0, display->width, display->height, false, false,
+        capture, 0, 0, display->width, display->height, display->height, display->width, 0, GOU_ROTATION_DEGREES_90,
+        GOU_BLEND_MODE_NONE, 0xff, GOU_SCALE_FILTER_DEFAULT, false);
+
+    const uint64_t sequence = Ge2dQueuedGet(display->ge2d);
+
+    pthread_mutex_unlock(&display->scanoutMutex);
+
+
+    if (!gou_screenshot_writer_submit(display->screenshotWriter, capture, display->screenshotPool, filename, sequence))
+    {
+        // The pool may free the surface, so the copy must finish first
+        WaitGe2d(display, sequence);
+        gou_surface_pool_release(display->screenshotPool, capture);
+
+        printf("gou_display_screenshot: too many screenshots pending.\n");
+        return false;
+    }
+
+    return true;
+}
+
+void gou_display_screenshot_flush(gou_display_t* display)
+{
+    // The writer is created by the thread taking screenshots
+    pthread_mutex_lock(&display->scanoutMutex);
+    gou_screenshot_writer_t* writer = display->screenshotWriter;
+    pthread_mutex_unlock(&display->scanoutMutex);
+
+    if (writer)
+    {
+        gou_screenshot_writer_flush(writer);
+    }
+}
+
+bool gou_display_recorder_start(gou_display_t* display, const gou_recorder_options_t* options)
+{
+    fb_var_screeninfo var_info;
+    if (FbIoctl(display, FBIOGET_VSCREENINFO, &var_info) < 0)
+    {
+        printf("FBIOGET_VSCREENINFO failed.\n");
+        return false;
+    }
+
+    // Sizes are in the presented orientation
+    gou_recorder_options_t resolved = *options;
+    resolved.width = options->width ? options->width : display->height;
+    resolved.height = options->height ? options->height : display->width;
+
+    // Checked first so a second start cannot truncate the file being written
+    pthread_mutex_lock(&display->scanoutMutex);
+    const bool recording = (display->recorder != NULL);
+    pthread_mutex_unlock(&display->scanoutMutex);
+
+    if (recording)
+    {
+        printf("gou_display_recorder_start: already recording.\n");
+        return false;
+    }
+
+    // Opening the file and allocating the ring happen before taking the
+    // lock the frame loop needs
+    gou_recorder_t* recorder = gou_recorder_create(display, &resolved, (int)RefreshPeriodGet(var_info), WaitGe2d);
+    if (!recorder)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&display->scanoutMutex);
+
+    bool result = false;
+    if (display->recorder)
+    {
+        printf("gou_display_recorder_start: already recording.\n");
+    }
+    else if (ScanoutSurfaceGet(display, 0))
+    {
+        // Every frame is captured from an exported flip buffer
+        display->recorder = recorder;
+        memset(&display->recorderStats, 0, sizeof(display->recorderStats));
+        result = true;
+    }
+
+    pthread_mutex_unlock(&display->scanoutMutex);
+
+    if (!result)
+    {
+        gou_recorder_destroy(recorder, NULL);
+    }
+
+    return result;
+}
+
+void gou_display_recorder_stop(gou_display_t* display)
+{
+    pthread_mutex_lock(&display->scanoutMutex);
+    gou_recorder_t* recorder = display->recorder;
+    display->recorder = NULL;
+    pthread_mutex_unlock(&display->scanoutMutex);
+
+    if (!recorder)
+    {
+        return;
+    }
+
+    // Draining happens without the lock so frames keep flipping
+    gou_recorder_stats_t stats;
+    gou_recorder_destroy(recorder, &stats);
+
+    pthread_mutex_lock(&display->scanoutMutex);
+    display->recorderStats = stats;
+    pthread_mutex_unlock(&display->scanoutMutex);
+}
+
+void gou_display_recorder_stats_get(gou_display_t* display, gou_recorder_stats_t* outStats)
+{
+    pthread_mutex_lock(&display->scanoutMutex);
+
+    if (display->recorder)
+    {
+        gou_recorder_stats_get(display->recorder, outStats);
+    }
+    else
+    {
+        *outStats = display->recorderStats;
+    }
+
+    pthread_mutex_unlock(&display->scanoutMutex);
+}
@@ -24,6 +24,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 
 typedef struct gou_display gou_display_t;
 typedef struct gou_surface gou_surface_t;
+typedef struct gou_frame_arena gou_frame_arena_t;
 
 
 typedef enum gou_rotation
@@ -34,20 +35,236 @@ typedef enum gou_rotation
     GOU_ROTATION_DEGREES_270
 } gou_rotation_t;
 
+// FIFO shows every frame in order on vblank. MAILBOX shows the newest
+// frame on vblank, replacing frames not yet shown. IMMEDIATE shows the
+// newest frame right away and may tear.
+typedef enum gou_present_mode
+{
+    GOU_PRESENT_MODE_FIFO = 0,
+    GOU_PRESENT_MODE_MAILBOX,
+    GOU_PRESENT_MODE_IMMEDIATE
+} gou_present_mode_t;
+
+typedef enum gou_blend_mode
+{
+    GOU_BLEND_MODE_NONE = 0,
+    GOU_BLEND_MODE_PREMULTIPLIED,
+    GOU_BLEND_MODE_COVERAGE
+} gou_blend_mode_t;
+
+// DEFAULT leaves the driver's bilinear filter untouched; on a layer it
+// uses the display's filter instead. NEAREST keeps pixel art sharp.
+// SHARP_BILINEAR prescales by a whole factor with nearest, then
+// bilinear scales the rest of the way for even, crisp pixels.
+typedef enum gou_scale_filter
+{
+    GOU_SCALE_FILTER_DEFAULT = 0,
+    GOU_SCALE_FILTER_NEAREST,
+    GOU_SCALE_FILTER_BILINEAR,
+    GOU_SCALE_FILTER_BICUBIC,
+    GOU_SCALE_FILTER_SHARP_BILINEAR
+} gou_scale_filter_t;
+
+// Completion handle for a queued present, increasing in submission order
+typedef uint64_t gou_display_fence_t;
+
+#define GOU_DISPLAY_FENCE_NONE (0)
+
+// Why a present returned GOU_DISPLAY_FENCE_NONE
+typedef enum gou_present_result
+{
+    GOU_PRESENT_RESULT_QUEUED = 0,
+    GOU_PRESENT_RESULT_BUSY,        // no framebuffer free, try again later
+    GOU_PRESENT_RESULT_ERROR        // the frame can never be presented as given
+} gou_present_result_t;
+
+typedef struct gou_display_ge2d_stats
+{
+    uint64_t config_hits;
+    uint64_t config_misses;
+} gou_display_ge2d_stats_t;
+
+// Timestamps are CLOCK_MONOTONIC microseconds
+typedef struct gou_display_frame_timing
+{
+    gou_display_fence_t fence;
+    uint64_t present_us;        // present was called
+    uint64_t free_wait_us;      // blocked waiting for a free framebuffer
+    uint64_t clear_us;          // issuing the background fills
+    uint64_t blit_us;           // composition until GE2D completed the frame
+    uint64_t ready_us;          // GE2D completed the frame
+    uint64_t flip_us;           // the flip ioctl returned
+    uint64_t flip_interval_us;  // since the previous flip
+    int queue_depth;            // frames queued ahead when presented
+    int missed_vblanks;         // vblanks passed while the frame was ready
+} gou_display_frame_timing_t;
+
+typedef struct gou_display_percentiles
+{
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t max;
+} gou_display_percentiles_t;
+
+// Percentiles cover the last GOU_DISPLAY_STATS_HISTORY frames shown
+#define GOU_DISPLAY_STATS_HISTORY (128)
+
+typedef struct gou_display_stats
+{
+    uint64_t frames_presented;
+    uint64_t frames_shown;
+    uint64_t frames_dropped;    // replaced before being shown
+    uint64_t missed_vblanks;
+    gou_display_frame_timing_t last;
+    gou_display_percentiles_t free_wait;
+    gou_display_percentiles_t clear;
+    gou_display_percentiles_t blit;
+    gou_display_percentiles_t latency;  // present to flip
+    gou_display_percentiles_t flip_interval;
+} gou_display_stats_t;
+
+typedef struct gou_rect
+{
+    int x;
+    int y;
+    int width;
+    int height;
+} gou_rect_t;
+
+// buffer_count 0 keeps the flip buffer count configured by the driver.
+// virtual_display (or GOU_DISPLAY=virtual) uses a headless framebuffer
+// in memory with a synthetic vblank instead of /dev/fb0 and GE2D; zero
+// sizes and refresh rate select the handheld's defaults.
+typedef struct gou_display_options
+{
+    int buffer_count;
+    gou_present_mode_t present_mode;
+    bool virtual_display;
+    int virtual_width;
+    int virtual_height;
+    int virtual_refresh_rate;
+} gou_display_options_t;
+
+#define GOU_DISPLAY_MAX_LAYERS (8)
+
+typedef enum gou_recorder_container
+{
+    GOU_RECORDER_CONTAINER_Y4M = 0,
+    GOU_RECORDER_CONTAINER_RAW
+} gou_recorder_container_t;
+
+// Frames are recorded in the presented orientation. format 0 selects
+// DRM_FORMAT_NV12; Y4M takes NV12 or YUV420, raw also takes packed RGB
+// formats. Zero sizes record at display size (YUV sizes are rounded down
+// to even), ring_size 0 keeps GOU_RECORDER_DEFAULT_RING_SIZE frames.
+typedef struct gou_recorder_options
+{
+    const char* filename;
+    gou_recorder_container_t container;
+    uint32_t format;
+    int width;
+    int height;
+    int ring_size;
+} gou_recorder_options_t;
+
+#define GOU_RECORDER_DEFAULT_RING_SIZE (8)
+
+typedef struct gou_recorder_stats
+{
+    uint64_t frames_captured;
+    uint64_t frames_written;
+    uint64_t frames_dropped;    // no ring slot free, or the file could not be written
+    uint64_t bytes_written;
+} gou_recorder_stats_t;
+
+// Rectangles are in the same coordinates as gou_display_present.
+// alpha is a global alpha applied to the whole layer (0xff = opaque).
+typedef struct gou_display_layer
+{
+    gou_surface_t* surface;
+    gou_rect_t src;
+    gou_rect_t dst;
+    bool mirror_x;
+    bool mirror_y;
+    uint8_t alpha;
+    gou_blend_mode_t blend_mode;
+    gou_scale_filter_t filter;
+} gou_display_layer_t;
+
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 gou_display_t* gou_display_create();
+// The buffer count actually used may differ from the one requested
+gou_display_t* gou_display_create_ex(const gou_display_options_t* options);
 void gou_display_destroy(gou_display_t* display);
 int gou_display_width_get(gou_display_t* display);
 int gou_display_height_get(gou_display_t* display);
+int gou_display_buffer_count_get(gou_display_t* display);
 void gou_display_present(gou_display_t* display, gou_surface_t* surface,
             int srcX, int srcY, int srcWidth, int srcHeight, bool mirrorX, bool mirrorY,
             int dstX, int dstY, int dstWidth, int dstHeight);
+
+// The surface must not be modified or destroyed until the returned fence
+// has signaled. A frame arena set on the display is not reset by these.
+gou_display_fence_t gou_display_present_async(gou_display_t* display, gou_surface_t* surface,
+            int srcX, int srcY, int srcWidth, int srcHeight, bool mirrorX, bool mirrorY,
+            int dstX, int dstY, int dstWidth, int dstHeight);
+// Returns GOU_DISPLAY_FENCE_NONE instead of waiting when no framebuffer is
+// free. outResult (may be NULL) tells that apart from a failure.
+gou_display_fence_t gou_display_present_try(gou_display_t* display, gou_surface_t* surface,
+            int srcX, int srcY, int srcWidth, int srcHeight, bool mirrorX, bool mirrorY,
+            int dstX, int dstY, int dstWidth, int dstHeight, gou_present_result_t* outResult);
+// Layers are composited in order, the first being the bottom most
+void gou_display_present_layers(gou_display_t* display, const gou_display_layer_t* layers, int count);
+gou_display_fence_t gou_display_present_layers_async(gou_display_t* display, const gou_display_layer_t* layers, int count);
+// Zero copy presentation: returns the next free flip buffer as a surface
+// to draw the whole frame into, waiting like gou_display_present does.
+// The surface is XRGB8888 in the panel's native portrait orientation
+// (gou_display_height_get wide by gou_display_width_get tall): the pixel
+// presented at (x, y) is at (y, gou_display_width_get - 1 - x). Returns
+// NULL if the driver cannot export its framebuffers. Every acquired
+// surface must be passed to gou_display_scanout_present, which flips to
+// it without any GE2D work, once per acquire; other surfaces are refused
+// with GOU_DISPLAY_FENCE_NONE. Scanout surfaces are owned by the display.
+gou_surface_t* gou_display_scanout_acquire(gou_display_t* display);
+gou_display_fence_t gou_display_scanout_present(gou_display_t* display, gou_surface_t* surface);
+bool gou_display_fence_signaled(gou_display_t* display, gou_display_fence_t fence);
+void gou_display_fence_wait(gou_display_t* display, gou_display_fence_t fence);
+bool gou_display_format_supported(uint32_t format);
 uint32_t gou_display_background_color_get(gou_display_t* display);
 void gou_display_background_color_set(gou_display_t* display, uint32_t value);
+gou_present_mode_t gou_display_present_mode_get(gou_display_t* display);
+void gou_display_present_mode_set(gou_display_t* display, gou_present_mode_t value);
+gou_scale_filter_t gou_display_scale_filter_get(gou_display_t* display);
+void gou_display_scale_filter_set(gou_display_t* display, gou_scale_filter_t value);
+gou_frame_arena_t* gou_display_frame_arena_get(gou_display_t* display);
+void gou_display_frame_arena_set(gou_display_t* display, gou_frame_arena_t* value);
+void gou_display_stats_get(gou_display_t* display, gou_display_stats_t* outStats);
+void gou_display_stats_reset(gou_display_t* display);
+// Counts GE2D configurations issued and skipped; the GE2D device is shared by all displays
+void gou_display_ge2d_stats_get(gou_display_t* display, gou_display_ge2d_stats_t* outStats);
+// Saves the frame on screen as a PNG in the presented orientation. GE2D
+// copies the frame and a background thread encodes it, so this returns
+// quickly; false if the capture could not be queued.
+bool gou_display_screenshot(gou_display_t* display, const char* filename);
+// Waits until queued screenshots have been written
+void gou_display_screenshot_flush(gou_display_t* display);
+// Copies every frame shown into a ring of surfaces with GE2D; a background
+// thread streams them to the file. Frames are dropped rather than delaying
+// the display when the file falls behind. Y4M files are stamped with the
+// display refresh rate and each flip is one frame, so content presented at
+// a lower rate, or in mailbox or immediate mode, plays back at the wrong
+// speed. Returns false if already recording or the options are not
+// supported.
+bool gou_display_recorder_start(gou_display_t* display, const gou_recorder_options_t* options);
+// Writes the frames still in the ring, then closes the file
+void gou_display_recorder_stop(gou_display_t* display);
+// Counts for the current recording, or the last one once stopped
+void gou_display_recorder_stats_get(gou_display_t* display, gou_recorder_stats_t* outStats);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,178 @@
+/*
+libgou - Support library for the ODROID-GO Ultra
+Copyright (C) 2022 OtherCrashOverride
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "format.h"
+
+#include <stddef.h>
+
+#include <drm/drm_fourcc.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+#include "ge2d.h"
+
+
+#define C(shift, bits) { shift, bits }
+#define NONE { 0, 0 }
+
+#define RGB(fourcc, bpp, r, g, b, a, ge2d, gl) \
+    { fourcc, bpp, 1, false, r, g, b, a, ge2d, gl }
+
+#define YUV(fourcc, bpp, planes, ge2d) \
+    { fourcc, bpp, planes, true, NONE, NONE, NONE, NONE, ge2d, 0 }
+
+
+static constexpr gou_format_info_t formats[] = {
+    RGB(DRM_FORMAT_R8,          8,  C(0, 8),  NONE,     NONE,     NONE,     0, 0),
+
+    // 16bit
+    RGB(DRM_FORMAT_XRGB4444,    16, C(8, 4),  C(4, 4),  C(0, 4),  NONE,     0, 0),
+    RGB(DRM_FORMAT_XBGR4444,    16, C(0, 4),  C(4, 4),  C(8, 4),  NONE,     0, 0),
+    RGB(DRM_FORMAT_RGBX4444,    16, C(12, 4), C(8, 4),  C(4, 4),  NONE,     0, 0),
+    RGB(DRM_FORMAT_BGRX4444,    16, C(4, 4),  C(8, 4),  C(12, 4), NONE,     0, 0),
+    RGB(DRM_FORMAT_ARGB4444,    16, C(8, 4),  C(4, 4),  C(0, 4),  C(12, 4), 0, 0),
+    RGB(DRM_FORMAT_ABGR4444,    16, C(0, 4),  C(4, 4),  C(8, 4),  C(12, 4), 0, 0),
+    RGB(DRM_FORMAT_RGBA4444,    16, C(12, 4), C(8, 4),  C(4, 4),  C(0, 4),  GE2D_FORMAT_S16_RGBA_4444, 0),
+    RGB(DRM_FORMAT_BGRA4444,    16, C(4, 4),  C(8, 4),  C(12, 4), C(0, 4),  0, 0),
+
+    RGB(DRM_FORMAT_XRGB1555,    16, C(10, 5), C(5, 5),  C(0, 5),  NONE,     0, 0),
+    RGB(DRM_FORMAT_XBGR1555,    16, C(0, 5),  C(5, 5),  C(10, 5), NONE,     0, 0),
+    RGB(DRM_FORMAT_RGBX5551,    16, C(11, 5), C(6, 5),  C(1, 5),  NONE,     0, 0),
+    RGB(DRM_FORMAT_BGRX5551,    16, C(1, 5),  C(6, 5),  C(11, 5), NONE,     0, 0),
+    RGB(DRM_FORMAT_ARGB1555,    16, C(10, 5), C(5, 5),  C(0, 5),  C(15, 1), 0, 0),
+    RGB(DRM_FORMAT_ABGR1555,    16, C(0, 5),  C(5, 5),  C(10, 5), C(15, 1), 0, 0),
+    RGB(DRM_FORMAT_RGBA5551,    16, C(11, 5), C(6, 5),  C(1, 5),  C(0, 1),  GE2D_FORMAT_S16_ARGB_1555, 0),
+    RGB(DRM_FORMAT_BGRA5551,    16, C(1, 5),  C(6, 5),  C(11, 5), C(0, 1),  0, 0),
+
+    RGB(DRM_FORMAT_RGB565,      16, C(11, 5), C(5, 6),  C(0, 5),  NONE,     GE2D_FORMAT_S16_RGB_565, GL_RGB565),
+    RGB(DRM_FORMAT_BGR565,      16, C(0, 5),  C(5, 6),  C(11, 5), NONE,     0, 0),
+
+    // 24bit
+    RGB(DRM_FORMAT_RGB888,      24, C(16, 8), C(8, 8),  C(0, 8),  NONE,     GE2D_FORMAT_S24_RGB, 0),
+    RGB(DRM_FORMAT_BGR888,      24, C(0, 8),  C(8, 8),  C(16, 8), NONE,     GE2D_FORMAT_S24_BGR, 0),
+
+    // 32bit
+    RGB(DRM_FORMAT_XRGB8888,    32, C(16, 8), C(8, 8),  C(0, 8),  NONE,     GE2D_FORMAT_S32_ARGB, 0),
+    RGB(DRM_FORMAT_XBGR8888,    32, C(0, 8),  C(8, 8),  C(16, 8), NONE,     GE2D_FORMAT_S32_ABGR, GL_RGBA8_OES),
+    RGB(DRM_FORMAT_RGBX8888,    32, C(24, 8), C(16, 8), C(8, 8),  NONE,     GE2D_FORMAT_S32_RGBA, 0),
+    RGB(DRM_FORMAT_BGRX8888,    32, C(8, 8),  C(16, 8), C(24, 8), NONE,     GE2D_FORMAT_S32_BGRA, 0),
+    RGB(DRM_FORMAT_ARGB8888,    32, C(16, 8), C(8, 8),  C(0, 8),  C(24, 8), GE2D_FORMAT_S32_ARGB, 0),
+    RGB(DRM_FORMAT_ABGR8888,    32, C(0, 8),  C(8, 8),  C(16, 8), C(24, 8), GE2D_FORMAT_S32_ABGR, GL_RGBA8_OES),
+    RGB(DRM_FORMAT_RGBA8888,    32, C(24, 8), C(16, 8), C(8, 8),  C(0, 8),  GE2D_FORMAT_S32_RGBA, 0),
+    RGB(DRM_FORMAT_BGRA8888,    32, C(8, 8),  C(16, 8), C(24, 8), C(0, 8),  0, 0),
+
+    RGB(DRM_FORMAT_XRGB2101010, 32, C(20, 10), C(10, 10), C(0, 10),  NONE,    0, 0),
+    RGB(DRM_FORMAT_XBGR2101010, 32, C(0, 10),  C(10, 10), C(20, 10), NONE,    0, 0),
+    RGB(DRM_FORMAT_RGBX1010102, 32, C(22, 10), C(12, 10), C(2, 10),  NONE,    0, 0),
+    RGB(DRM_FORMAT_BGRX1010102, 32, C(2, 10),  C(12, 10), C(22, 10), NONE,    0, 0),
+    RGB(DRM_FORMAT_ARGB2101010, 32, C(20, 10), C(10, 10), C(0, 10),  C(30, 2), 0, 0),
+    RGB(DRM_FORMAT_ABGR2101010, 32, C(0, 10),  C(10, 10), C(20, 10), C(30, 2), 0, 0),
+    RGB(DRM_FORMAT_RGBA1010102, 32, C(22, 10), C(12, 10), C(2, 10),  C(0, 2),  0, 0),
+    RGB(DRM_FORMAT_BGRA1010102, 32, C(2, 10),  C(12, 10), C(22, 10), C(0, 2),  0, 0),
+
+    // YUV (converted to RGB by GE2D)
+    YUV(DRM_FORMAT_NV12,        12, 2, GE2D_FORMAT_M24_NV12),
+    YUV(DRM_FORMAT_NV21,        12, 2, GE2D_FORMAT_M24_NV21),
+    YUV(DRM_FORMAT_YUV420,      12, 3, GE2D_FORMAT_M24_YUV420),
+    YUV(DRM_FORMAT_YVU420,      12, 3, GE2D_FORMAT_M24_YUV420)
+};
+
+static constexpr size_t FORMAT_COUNT = sizeof(formats) / sizeof(formats[0]);
+
+
+// Open addressed hash of fourcc -> table index, built at compile time
+#define FORMAT_HASH_BITS (7)
+#define FORMAT_HASH_SIZE (1 << FORMAT_HASH_BITS)
+
+static_assert(FORMAT_COUNT * 2 <= FORMAT_HASH_SIZE, "format hash is too small");
+
+typedef struct format_index
+{
+    int8_t slots[FORMAT_HASH_SIZE];
+} format_index_t;
+
+static constexpr uint32_t Hash(uint32_t fourcc)
+{
+    return (uint32_t)(fourcc * 2654435761u) >> (32 - FORMAT_HASH_BITS);
+}
+
+static constexpr format_index_t BuildIndex()
+{
+    format_index_t result = { };
+
+    for (size_t i = 0; i < FORMAT_HASH_SIZE; ++i)
+    {
+        result.slots[i] = -1;
+    }
+
+    for (size_t i = 0; i < FORMAT_COUNT; ++i)
+    {
+        uint32_t slot = Hash(formats[i].drm_fourcc);
+        while (result.slots[slot] >= 0)
+        {
+            slot = (slot + 1) & (FORMAT_HASH_SIZE - 1);
+        }
+
+        result.slots[slot] = (int8_t)i;
+    }
+
+    return result;
+}
+
+static constexpr format_index_t formatIndex = BuildIndex();
+
+
+const gou_format_info_t* gou_format_info_get(uint32_t format)
+{
+    uint32_t slot = Hash(format);
+    while (formatIndex.slots[slot] >= 0)
+    {
+        const gou_format_info_t* info = &formats[formatIndex.slots[slot]];
+        if (info->drm_fourcc == format)
+        {
+            return info;
+        }
+
+        slot = (slot + 1) & (FORMAT_HASH_SIZE - 1);
+    }
+
+    return NULL;
+}
+
+const gou_format_info_t* gou_format_info_find_ge2d(uint32_t ge2d_format)
+{
+    // GE2D reads the padding byte of X formats as alpha
+    const gou_format_info_t* result = NULL;
+
+    for (size_t i = 0; i < FORMAT_COUNT; ++i)
+    {
+        const gou_format_info_t* info = &formats[i];
+        if (info->ge2d_format != ge2d_format)
+        {
+            continue;
+        }
+
+        if (!result || (info->a.bits && !result->a.bits))
+        {
+            result = info;
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+/*
+libgou - Support library for the ODROID-GO Ultra
+Copyright (C) 2022 OtherCrashOverride
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stdint.h>
+
+
+typedef struct gou_format_component
+{
+    uint8_t shift;
+    uint8_t bits;   // 0 if the component is not present
+} gou_format_component_t;
+
+typedef struct gou_format_info
+{
+    uint32_t drm_fourcc;            // also used as EGL_LINUX_DRM_FOURCC_EXT
+    int bpp;                        // averaged over all planes
+    int plane_count;
+    bool yuv;
+
+    // Position within a packed little-endian pixel (RGB formats only)
+    gou_format_component_t r;
+    gou_format_component_t g;
+    gou_format_component_t b;
+    gou_format_component_t a;
+
+    uint32_t ge2d_format;           // 0 if GE2D cannot read the format
+    uint32_t gl_internal_format;    // 0 if not usable as a GL render target
+} gou_format_info_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Returns NULL for formats libgou does not support
+const gou_format_info_t* gou_format_info_get(uint32_t format);
+
+// Reverse lookup of the layout GE2D uses for a format code. Returns NULL
+// for codes libgou never issues.
+const gou_format_info_t* gou_format_info_find_ge2d(uint32_t ge2d_format);
+
+
+#ifdef __cplusplus
+}
+#endif
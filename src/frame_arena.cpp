@@ -0,0 +1,152 @@
+/*
+libgou - Support library for the ODROID-GO Ultra
+Copyright (C) 2022 OtherCrashOverride
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "frame_arena.h"
+
+#include <vector>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <drm/drm_fourcc.h>
+
+
+#define ALIGN(val, align)	(((val) + (align) - 1) & ~((align) - 1))
+
+// Matches the stride alignment used by gou_surface_create
+#define ARENA_ALIGNMENT (64)
+
+
+typedef struct gou_frame_arena
+{
+    gou_surface_t* backing;
+    int size;
+    int used;
+    int highWater;
+    int viewCount;
+
+    // View headers are kept across resets. A frame that allocates the same
+    // sequence of surfaces as the previous one reuses them unchanged.
+    std::vector<gou_surface_t*>* views;
+} gou_frame_arena_t;
+
+
+gou_frame_arena_t* gou_frame_arena_create(gou_display_t* display, int size)
+{
+    gou_frame_arena_t* result = (gou_frame_arena_t*)malloc(sizeof(gou_frame_arena_t));
+    if (!result)
+    {
+        printf("malloc failed.\n");
+        abort();
+    }
+
+    memset(result, 0, sizeof(*result));
+
+    // The backing store is a single row of bytes
+    size = ALIGN(size, ARENA_ALIGNMENT);
+    result->backing = gou_surface_create(display, size, 1, DRM_FORMAT_R8);
+    result->size = gou_surface_stride_get(result->backing);
+
+    // Export once up front so no views pay for it during a frame
+    gou_surface_share_fd(result->backing);
+
+    result->views = new std::vector<gou_surface_t*>;
+
+    return result;
+}
+
+void gou_frame_arena_destroy(gou_frame_arena_t* arena)
+{
+    for (size_t i = 0; i < arena->views->size(); ++i)
+    {
+        gou_surface_destroy((*arena->views)[i]);
+    }
+
+    delete arena->views;
+
+    gou_surface_destroy(arena->backing);
+
+    free(arena);
+}
+
+gou_surface_t* gou_frame_arena_surface_create(gou_frame_arena_t* arena, int width, int height, uint32_t format)
+{
+    if (!gou_format_info_get(format))
+    {
+        return NULL;
+    }
+
+    const int stride = gou_drm_format_get_stride(format, width);
+    const int length = ALIGN(gou_drm_format_get_size(format, width, height), ARENA_ALIGNMENT);
+
+    if (arena->used + length > arena->size)
+    {
+        return NULL;
+    }
+
+    const int offset = arena->used;
+    arena->used += length;
+    if (arena->used > arena->highWater) arena->highWater = arena->used;
+
+    std::vector<gou_surface_t*>& views = *arena->views;
+    const size_t index = arena->viewCount++;
+
+    if (index < views.size())
+    {
+        gou_surface_t* view = views[index];
+        if (gou_surface_offset_get(view) == offset &&
+            gou_surface_width_get(view) == width &&
+            gou_surface_height_get(view) == height &&
+            gou_surface_format_get(view) == format)
+        {
+            return view;
+        }
+
+        gou_surface_destroy(view);
+        views[index] = gou_surface_create_view(arena->backing, offset, width, height, format, stride);
+    }
+    else
+    {
+        views.push_back(gou_surface_create_view(arena->backing, offset, width, height, format, stride));
+    }
+
+    return views[index];
+}
+
+void gou_frame_arena_reset(gou_frame_arena_t* arena)
+{
+    arena->used = 0;
+    arena->viewCount = 0;
+}
+
+int gou_frame_arena_size_get(gou_frame_arena_t* arena)
+{
+    return arena->size;
+}
+
+int gou_frame_arena_used_get(gou_frame_arena_t* arena)
+{
+    return arena->used;
+}
+
+int gou_frame_arena_high_water_get(gou_frame_arena_t* arena)
+{
+    return arena->highWater;
+}
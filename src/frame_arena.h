@@ -0,0 +1,45 @@
+#pragma once
+
+/*
+libgou - Support library for the ODROID-GO Ultra
+Copyright (C) 2022 OtherCrashOverride
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "surface.h"
+
+
+typedef struct gou_frame_arena gou_frame_arena_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Surfaces returned by the arena are only valid until the next reset. When
+// attached to a display the arena is reset after every present.
+gou_frame_arena_t* gou_frame_arena_create(gou_display_t* display, int size);
+void gou_frame_arena_destroy(gou_frame_arena_t* arena);
+gou_surface_t* gou_frame_arena_surface_create(gou_frame_arena_t* arena, int width, int height, uint32_t format);
+void gou_frame_arena_reset(gou_frame_arena_t* arena);
+int gou_frame_arena_size_get(gou_frame_arena_t* arena);
+int gou_frame_arena_used_get(gou_frame_arena_t* arena);
+int gou_frame_arena_high_water_get(gou_frame_arena_t* arena);
+
+
+#ifdef __cplusplus
+}
+#endif
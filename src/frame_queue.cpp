@@ -0,0 +1,173 @@
+/*
+libgou - Support library for the ODROID-GO Ultra
+Copyright (C) 2022 OtherCrashOverride
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "frame_queue.h"
+
+#include <atomic>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+
+typedef struct gou_frame_queue
+{
+    int* values;
+    uint32_t mask;
+    std::atomic<uint32_t> head;         // next to pop
+    std::atomic<uint32_t> tail;         // next to push
+    std::atomic<uint32_t> sequence;     // futex word, changes on every push and on close
+    std::atomic<int> waiters;
+    std::atomic<bool> closed;
+} gou_frame_queue_t;
+
+
+static void FutexWait(std::atomic<uint32_t>* word, uint32_t value)
+{
+    syscall(SYS_futex, (uint32_t*)word, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+static void FutexWake(std::atomic<uint32_t>* word)
+{
+    syscall(SYS_futex, (uint32_t*)word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+static void Signal(gou_frame_queue_t* queue)
+{
+    queue->sequence.fetch_add(1);
+
+    // Only enter the kernel if a consumer is actually sleeping
+    if (queue->waiters.load() > 0)
+    {
+        FutexWake(&queue->sequence);
+    }
+}
+
+
+gou_frame_queue_t* gou_frame_queue_create(int capacity)
+{
+    gou_frame_queue_t* result = (gou_frame_queue_t*)malloc(sizeof(gou_frame_queue_t));
+    if (!result)
+    {
+        printf("malloc failed.\n");
+        abort();
+    }
+
+    // The atomics are zero initialized along with the rest
+    memset((void*)result, 0, sizeof(*result));
+
+    // Indices wrap at 2^32 so the capacity must be a power of two
+    uint32_t size = 1;
+    while (size < (uint32_t)capacity)
+    {
+        size <<= 1;
+    }
+
+    result->values = (int*)malloc(size * sizeof(int));
+    if (!result->values)
+    {
+        printf("malloc failed.\n");
+        abort();
+    }
+
+    result->mask = size - 1;
+
+    return result;
+}
+
+void gou_frame_queue_destroy(gou_frame_queue_t* queue)
+{
+    free(queue->values);
+    free(queue);
+}
+
+void gou_frame_queue_push(gou_frame_queue_t* queue, int value)
+{
+    const uint32_t tail = queue->tail.load(std::memory_order_relaxed);
+    if (tail - queue->head.load(std::memory_order_acquire) > queue->mask)
+    {
+        printf("gou_frame_queue_push: queue full.\n");
+        abort();
+    }
+
+    queue->values[tail & queue->mask] = value;
+    queue->tail.store(tail + 1, std::memory_order_release);
+
+    Signal(queue);
+}
+
+bool gou_frame_queue_try_pop(gou_frame_queue_t* queue, int* outValue)
+{
+    uint32_t head = queue->head.load(std::memory_order_acquire);
+    while (true)
+    {
+        if (head == queue->tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        // The slot cannot be reused by the producer until head moves past it
+        const int value = queue->values[head & queue->mask];
+        if (queue->head.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel))
+        {
+            *outValue = value;
+            return true;
+        }
+    }
+}
+
+bool gou_frame_queue_pop(gou_frame_queue_t* queue, int* outValue)
+{
+    while (true)
+    {
+        const uint32_t sequence = queue->sequence.load();
+
+        if (gou_frame_queue_try_pop(queue, outValue))
+        {
+            return true;
+        }
+
+        if (queue->closed.load())
+        {
+            return false;
+        }
+
+        queue->waiters.fetch_add(1);
+        FutexWait(&queue->sequence, sequence);
+        queue->waiters.fetch_sub(1);
+    }
+}
+
+void gou_frame_queue_close(gou_frame_queue_t* queue)
+{
+    queue->closed.store(true);
+    Signal(queue);
+}
+
+int gou_frame_queue_size_get(gou_frame_queue_t* queue)
+{
+    const uint32_t head = queue->head.load(std::memory_order_acquire);
+    const uint32_t tail = queue->tail.load(std::memory_order_acquire);
+
+    return (int)(tail - head);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+/*
+libgou - Support library for the ODROID-GO Ultra
+Copyright (C) 2022 OtherCrashOverride
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stdint.h>
+
+
+// Fixed capacity lock-free ring of ints. Only one thread may push; pops
+// from several threads are safe. Waiting uses a futex and only happens
+// when the ring is empty.
+typedef struct gou_frame_queue gou_frame_queue_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+gou_frame_queue_t* gou_frame_queue_create(int capacity);
+void gou_frame_queue_destroy(gou_frame_queue_t* queue);
+void gou_frame_queue_push(gou_frame_queue_t* queue, int value);
+bool gou_frame_queue_try_pop(gou_frame_queue_t* queue, int* outValue);
+// Returns false once the queue is closed and empty
+bool gou_frame_queue_pop(gou_frame_queue_t* queue, int* outValue);
+void gou_frame_queue_close(gou_frame_queue_t* queue);
+int gou_frame_queue_size_get(gou_frame_queue_t* queue);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,35 @@
+#pragma once
+
+/*
+libgou - Support library for the ODROID-GO Ultra
+Copyright (C) 2022 OtherCrashOverride
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <linux/types.h>
+
+
+// Amlogic OSD framebuffer extensions
+
+// Exports framebuffer memory as a dma-buf. Depending on the driver the
+// buffer covers every flip buffer or only the one at buffer_idx.
+#define FBIOGET_OSD_DMABUF               0x46fc
+
+struct fb_dmabuf_export {
+	__u32 buffer_idx;
+	__u32 fd;
+	__u32 flags;
+};
@@ -0,0 +1,425 @@
+/*
+libgou - Support library for the ODROID-GO Ultra
+Copyright (C) 2022 OtherCrashOverride
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "recorder.h"
+#include "format.h"
+#include "frame_queue.h"
+
+#include <vector>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include <drm/drm_fourcc.h>
+
+
+// Writing yields to the frame loop
+#define WRITER_NICE (10)
+
+// Batches the many small row writes into few large ones
+#define WRITE_BUFFER_SIZE (1024 * 1024)
+
+
+typedef struct gou_recorder
+{
+    gou_display_t* display;
+    gou_recorder_wait_t wait;
+    gou_recorder_container_t container;
+    uint32_t format;
+    const gou_format_info_t* formatInfo;
+    int width;
+    int height;
+    FILE* file;
+    char* writeBuffer;
+    std::vector<gou_surface_t*>* slots;
+    std::vector<uint64_t>* captures; // per slot, set before it is queued
+    std::vector<uint8_t>* row;      // chroma deinterleaved for Y4M
+    gou_frame_queue_t* freeSlots;   // pushed by the writer thread
+    gou_frame_queue_t* filledSlots; // pushed by the capturing thread
+    pthread_t thread;
+    bool threadStarted;
+    uint64_t frameBytes;            // writer thread only
+    bool failed;
+    gou_recorder_stats_t stats;
+    pthread_mutex_t mutex;
+} gou_recorder_t;
+
+
+static bool FormatSupported(gou_recorder_container_t container, const gou_format_info_t* info)
+{
+    if (!info || info->ge2d_format == 0)
+    {
+        return false;
+    }
+
+    // Y4M only describes planar Y, Cb, Cr; NV12 is deinterleaved when written
+    if (container == GOU_RECORDER_CONTAINER_Y4M)
+    {
+        return info->drm_fourcc == DRM_FORMAT_NV12 || info->drm_fourcc == DRM_FORMAT_YUV420;
+    }
+
+    return container == GOU_RECORDER_CONTAINER_RAW;
+}
+
+// Returns false once the file has failed
+static bool Write(gou_recorder_t* recorder, const void* data, size_t size)
+{
+    if (fwrite(data, 1, size, recorder->file) == size)
+    {
+        recorder->frameBytes += size;
+        return true;
+    }
+
+    return false;
+}
+
+static bool WriteFrame(gou_recorder_t* recorder, gou_surface_t* surface)
+{
+    const uint8_t* pixels = (const uint8_t*)gou_surface_map(surface);
+    const gou_format_info_t* info = recorder->formatInfo;
+
+    if (recorder->container == GOU_RECORDER_CONTAINER_Y4M)
+    {
+        static const char frameHeader[] = "FRAME\n";
+        if (!Write(recorder, frameHeader, sizeof(frameHeader) - 1))
+        {
+            return false;
+        }
+    }
+
+    for (int plane = 0; plane < info->plane_count; ++plane)
+    {
+        const uint8_t* src = pixels + gou_surface_plane_offset_get(surface, plane);
+        const int stride = gou_surface_plane_stride_get(surface, plane);
+
+        int rowBytes;
+        int rows;
+        if (!info->yuv)
+        {
+            rowBytes = recorder->width * (info->bpp / 8);
+            rows = recorder->height;
+        }
+        else if (plane == 0)
+        {
+            rowBytes = recorder->width;
+            rows = recorder->height;
+        }
+        else
+        {
+            // Interleaved chroma is as wide as luma in bytes
+            rowBytes = (info->plane_count == 2) ? recorder->width : recorder->width / 2;
+            rows = recorder->height / 2;
+        }
+
+        if (recorder->container == GOU_RECORDER_CONTAINER_Y4M && info->plane_count == 2 && plane == 1)
+        {
+            // Cb plane then Cr plane
+            const int chromaWidth = recorder->width / 2;
+            uint8_t* row = recorder->row->data();
+
+            for (int component = 0; component < 2; ++component)
+            {
+                for (int y = 0; y < rows; ++y)
+                {
+                    const uint8_t* pairs = src + y * stride;
+                    for (int x = 0; x < chromaWidth; ++x)
+                    {
+                        row[x] = pairs[x * 2 + component];
+                    }
+
+                    if (!Write(recorder, row, chromaWidth))
+                    {
+                        return false;
+                    }
+                }
+            }
+
+            continue;
+        }
+
+        for (int y = 0; y < rows; ++y)
+        {
+            if (!Write(recorder, src + y * stride, rowBytes))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static void* WriterThread(void* arg)
+{
+    gou_recorder_t* recorder = (gou_recorder_t*)arg;
+
+    // Nice values are per thread on Linux
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), WRITER_NICE);
+
+    int slot;
+    while (gou_frame_queue_pop(recorder->filledSlots, &slot))
+    {
+        gou_surface_t* surface = (*recorder->slots)[slot];
+
+        pthread_mutex_lock(&recorder->mutex);
+        bool failed = recorder->failed;
+        pthread_mutex_unlock(&recorder->mutex);
+
+        recorder->frameBytes = 0;
+
+        if (!failed)
+        {
+            recorder->wait(recorder->display, (*recorder->captures)[slot]);
+
+            gou_surface_begin_cpu_access(surface, GOU_SURFACE_ACCESS_READ, NULL);
+            failed = !WriteFrame(recorder, surface);
+            gou_surface_end_cpu_access(surface, GOU_SURFACE_ACCESS_READ, NULL);
+        }
+
+        gou_frame_queue_push(recorder->freeSlots, slot);
+
+        pthread_mutex_lock(&recorder->mutex);
+
+        if (failed)
+        {
+            if (!recorder->failed)
+            {
+                printf("gou_recorder: writing the file failed, dropping further frames.\n");
+            }
+
+            recorder->failed = true;
+            ++recorder->stats.frames_dropped;
+        }
+        else
+        {
+            ++recorder->stats.frames_written;
+        }
+
+        recorder->stats.bytes_written += recorder->frameBytes;
+
+        pthread_mutex_unlock(&recorder->mutex);
+    }
+
+    return NULL;
+}
+
+
+gou_recorder_t* gou_recorder_create(gou_display_t* display, const gou_recorder_options_t* options, int framePeriodUs,
+    gou_recorder_wait_t wait)
+{
+    const uint32_t format = options->format ? options->format : DRM_FORMAT_NV12;
+    const gou_format_info_t* info = gou_format_info_get(format);
+
+    if (!options->filename || !FormatSupported(options->container, info))
+    {
+        printf("gou_recorder_create: unsupported options.\n");
+        return NULL;
+    }
+
+    // Chroma is subsampled in both directions
+    const int width = info->yuv ? options->width & ~1 : options->width;
+    const int height = info->yuv ? options->height & ~1 : options->height;
+    if (width <= 0 || height <= 0)
+    {
+        printf("gou_recorder_create: invalid size (%d x %d).\n", options->width, options->height);
+        return NULL;
+    }
+
+    const int ringSize = (options->ring_size > 0) ? options->ring_size : GOU_RECORDER_DEFAULT_RING_SIZE;
+
+    FILE* file = fopen(options->filename, "wb");
+    if (!file)
+    {
+        printf("gou_recorder_create: fopen '%s' failed.\n", options->filename);
+        return NULL;
+    }
+
+
+    gou_recorder_t* result = (gou_recorder_t*)malloc(sizeof(gou_recorder_t));
+    if (!result)
+    {
+        printf("malloc failed.\n");
+        abort();
+    }
+
+    memset(result, 0, sizeof(*result));
+
+    result->display = display;
+    result->wait = wait;
+    result->container = options->container;
+    result->format = format;
+    result->formatInfo = info;
+    result->width = width;
+    result->height = height;
+    result->file = file;
+    result->slots = new std::vector<gou_surface_t*>;
+    result->captures = new std::vector<uint64_t>(ringSize);
+    result->row = new std::vector<uint8_t>(width / 2);
+    result->freeSlots = gou_frame_queue_create(ringSize);
+    result->filledSlots = gou_frame_queue_create(ringSize);
+
+    pthread_mutex_init(&result->mutex, NULL);
+
+    result->writeBuffer = (char*)malloc(WRITE_BUFFER_SIZE);
+    if (!result->writeBuffer)
+    {
+        printf("malloc failed.\n");
+        abort();
+    }
+
+    setvbuf(file, result->writeBuffer, _IOFBF, WRITE_BUFFER_SIZE);
+
+    // The ring is allocated up front so recording never allocates per frame.
+    // Cached mappings make the writer's reads cheap.
+    for (int i = 0; i < ringSize; ++i)
+    {
+        gou_surface_t* surface = gou_surface_create_ex(display, width, height, format, GOU_SURFACE_FLAG_CACHED);
+        if (!surface)
+        {
+            printf("gou_recorder_create: surface allocation failed.\n");
+            gou_recorder_destroy(result, NULL);
+            return NULL;
+        }
+
+        // Export now so capturing does not
+        gou_surface_share_fd(surface);
+
+        result->slots->push_back(surface);
+        gou_frame_queue_push(result->freeSlots, i);
+    }
+
+    if (options->container == GOU_RECORDER_CONTAINER_Y4M)
+    {
+        // The rate is nominal: each flip is written as one frame however
+        // long it stayed on screen, so content presented at another rate
+        // (or in mailbox and immediate modes) plays back at the wrong speed.
+        // Limited range BT.601 with chroma centred on each 2x2 block
+        if (fprintf(file, "YUV4MPEG2 W%d H%d F1000000:%d Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n",
+            width, height, framePeriodUs) < 0)
+        {
+            printf("gou_recorder_create: writing '%s' failed.\n", options->filename);
+            gou_recorder_destroy(result, NULL);
+            return NULL;
+        }
+    }
+
+    if (pthread_create(&result->thread, NULL, WriterThread, result) != 0)
+    {
+        printf("gou_recorder_create: pthread_create failed.\n");
+        abort();
+    }
+
+    result->threadStarted = true;
+
+    return result;
+}
+
+void gou_recorder_destroy(gou_recorder_t* recorder, gou_recorder_stats_t* outStats)
+{
+    gou_frame_queue_close(recorder->filledSlots);
+
+    if (recorder->threadStarted)
+    {
+        pthread_join(recorder->thread, NULL);
+    }
+
+    if (fclose(recorder->file) != 0 && !recorder->failed)
+    {
+        printf("gou_recorder: closing the file failed.\n");
+    }
+
+    if (outStats)
+    {
+        *outStats = recorder->stats;
+    }
+
+    for (size_t i = 0; i < recorder->slots->size(); ++i)
+    {
+        gou_surface_destroy((*recorder->slots)[i]);
+    }
+
+    gou_frame_queue_destroy(recorder->filledSlots);
+    gou_frame_queue_destroy(recorder->freeSlots);
+
+    pthread_mutex_destroy(&recorder->mutex);
+
+    free(recorder->writeBuffer);
+
+    delete recorder->row;
+    delete recorder->captures;
+    delete recorder->slots;
+
+    free(recorder);
+}
+
+int gou_recorder_width_get(gou_recorder_t* recorder)
+{
+    return recorder->width;
+}
+
+int gou_recorder_height_get(gou_recorder_t* recorder)
+{
+    return recorder->height;
+}
+
+int gou_recorder_acquire(gou_recorder_t* recorder)
+{
+    int slot;
+
+    pthread_mutex_lock(&recorder->mutex);
+
+    if (recorder->failed || !gou_frame_queue_try_pop(recorder->freeSlots, &slot))
+    {
+        ++recorder->stats.frames_dropped;
+        slot = -1;
+    }
+
+    pthread_mutex_unlock(&recorder->mutex);
+
+    return slot;
+}
+
+gou_surface_t* gou_recorder_surface_get(gou_recorder_t* recorder, int slot)
+{
+    return (*recorder->slots)[slot];
+}
+
+void gou_recorder_submit(gou_recorder_t* recorder, int slot, uint64_t capture)
+{
+    // The queue orders this before the writer's read
+    (*recorder->captures)[slot] = capture;
+
+    pthread_mutex_lock(&recorder->mutex);
+    ++recorder->stats.frames_captured;
+    pthread_mutex_unlock(&recorder->mutex);
+
+    gou_frame_queue_push(recorder->filledSlots, slot);
+}
+
+void gou_recorder_stats_get(gou_recorder_t* recorder, gou_recorder_stats_t* outStats)
+{
+    pthread_mutex_lock(&recorder->mutex);
+    *outStats = recorder->stats;
+    pthread_mutex_unlock(&recorder->mutex);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+/*
+libgou - Support library for the ODROID-GO Ultra
+Copyright (C) 2022 OtherCrashOverride
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "display.h"
+#include "surface.h"
+
+
+// Streams captured frames from a fixed ring of surfaces to a Y4M or raw
+// file on a background thread. One thread captures (acquire, fill,
+// submit); the ring never grows, so a slow file drops frames instead.
+typedef struct gou_recorder gou_recorder_t;
+
+// Captures are queued without waiting, so the writer thread calls this
+// before reading a frame. It returns once the capture submitted with the
+// frame has finished.
+typedef void (*gou_recorder_wait_t)(gou_display_t* display, uint64_t capture);
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// options must have its size resolved. Returns NULL when the options are
+// not supported or the file cannot be created. framePeriodUs is stamped
+// in the Y4M header as a constant rate; frames carry no timestamps.
+gou_recorder_t* gou_recorder_create(gou_display_t* display, const gou_recorder_options_t* options, int framePeriodUs,
+    gou_recorder_wait_t wait);
+// Writes the frames already submitted before returning. The final counts
+// are stored to outStats unless it is NULL.
+void gou_recorder_destroy(gou_recorder_t* recorder, gou_recorder_stats_t* outStats);
+int gou_recorder_width_get(gou_recorder_t* recorder);
+int gou_recorder_height_get(gou_recorder_t* recorder);
+// Returns a free slot, or -1 after counting a dropped frame
+int gou_recorder_acquire(gou_recorder_t* recorder);
+gou_surface_t* gou_recorder_surface_get(gou_recorder_t* recorder, int slot);
+// capture identifies the queued copy for the wait callback
+void gou_recorder_submit(gou_recorder_t* recorder, int slot, uint64_t capture);
+void gou_recorder_stats_get(gou_recorder_t* recorder, gou_recorder_stats_t* outStats);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,264 @@
+/*
+libgou - Support library for the ODROID-GO Ultra
+Copyright (C) 2022 OtherCrashOverride
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "screenshot.h"
+
+#include <queue>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include <drm/drm_fourcc.h>
+#include <png.h>
+
+
+// Encoding yields to the frame loop
+#define WRITER_NICE (10)
+
+// zlib's fastest level; screenshots favour latency over size
+#define PNG_COMPRESSION_LEVEL (1)
+
+
+typedef struct screenshot_job
+{
+    gou_surface_t* surface;
+    gou_surface_pool_t* pool;
+    char* filename;
+    uint64_t capture;
+} screenshot_job_t;
+
+typedef struct gou_screenshot_writer
+{
+    gou_display_t* display;
+    gou_screenshot_wait_t wait;
+    int maxPending;
+    int pending;    // queued or being written
+    bool terminating;
+    std::queue<screenshot_job_t>* jobs;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t jobCond;
+    pthread_cond_t idleCond;
+} gou_screenshot_writer_t;
+
+
+static bool WritePng(const char* filename, const uint8_t* pixels, int width, int height, int stride)
+{
+    FILE* file = fopen(filename, "wb");
+    if (!file)
+    {
+        printf("gou_screenshot: fopen '%s' failed.\n", filename);
+        return false;
+    }
+
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop info = png ? png_create_info_struct(png) : NULL;
+    if (!info)
+    {
+        printf("gou_screenshot: libpng initialization failed.\n");
+
+        png_destroy_write_struct(&png, NULL);
+        fclose(file);
+        return false;
+    }
+
+    if (setjmp(png_jmpbuf(png)))
+    {
+        printf("gou_screenshot: writing '%s' failed.\n", filename);
+
+        png_destroy_write_struct(&png, &info);
+        fclose(file);
+        return false;
+    }
+
+    png_init_io(png, file);
+    png_set_compression_level(png, PNG_COMPRESSION_LEVEL);
+    png_set_IHDR(png, info, width, height, 8, PNG_COLOR_TYPE_RGB,
+        PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png, info);
+
+    // Rows are R, G, B, X bytes
+    png_set_filler(png, 0, PNG_FILLER_AFTER);
+
+    for (int y = 0; y < height; ++y)
+    {
+        png_write_row(png, (png_const_bytep)(pixels + y * stride));
+    }
+
+    png_write_end(png, NULL);
+    png_destroy_write_struct(&png, &info);
+
+    fclose(file);
+    return true;
+}
+
+static void WriteJob(gou_screenshot_writer_t* writer, const screenshot_job_t& job)
+{
+    gou_surface_t* surface = job.surface;
+
+    writer->wait(writer->display, job.capture);
+
+    if (gou_surface_format_get(surface) != DRM_FORMAT_XBGR8888)
+    {
+        printf("gou_screenshot: unsupported surface format.\n");
+        return;
+    }
+
+    gou_surface_begin_cpu_access(surface, GOU_SURFACE_ACCESS_READ, NULL);
+
+    WritePng(job.filename, (const uint8_t*)gou_surface_map(surface),
+        gou_surface_width_get(surface), gou_surface_height_get(surface), gou_surface_stride_get(surface));
+
+    gou_surface_end_cpu_access(surface, GOU_SURFACE_ACCESS_READ, NULL);
+}
+
+static void* WriterThread(void* arg)
+{
+    gou_screenshot_writer_t* writer = (gou_screenshot_writer_t*)arg;
+
+    // Nice values are per thread on Linux
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), WRITER_NICE);
+
+    pthread_mutex_lock(&writer->mutex);
+
+    while (true)
+    {
+        while (writer->jobs->empty() && !writer->terminating)
+        {
+            pthread_cond_wait(&writer->jobCond, &writer->mutex);
+        }
+
+        if (writer->jobs->empty())
+        {
+            break;
+        }
+
+        screenshot_job_t job = writer->jobs->front();
+        writer->jobs->pop();
+
+        pthread_mutex_unlock(&writer->mutex);
+
+        WriteJob(writer, job);
+
+        gou_surface_pool_release(job.pool, job.surface);
+        free(job.filename);
+
+        pthread_mutex_lock(&writer->mutex);
+
+        if (--writer->pending == 0)
+        {
+            pthread_cond_broadcast(&writer->idleCond);
+        }
+    }
+
+    pthread_mutex_unlock(&writer->mutex);
+
+    return NULL;
+}
+
+
+gou_screenshot_writer_t* gou_screenshot_writer_create(int maxPending, gou_display_t* display, gou_screenshot_wait_t wait)
+{
+    gou_screenshot_writer_t* result = (gou_screenshot_writer_t*)malloc(sizeof(gou_screenshot_writer_t));
+    if (!result)
+    {
+        printf("malloc failed.\n");
+        abort();
+    }
+
+    memset(result, 0, sizeof(*result));
+
+    result->display = display;
+    result->wait = wait;
+    result->maxPending = (maxPending > 0) ? maxPending : 1;
+    result->jobs = new std::queue<screenshot_job_t>;
+
+    pthread_mutex_init(&result->mutex, NULL);
+    pthread_cond_init(&result->jobCond, NULL);
+    pthread_cond_init(&result->idleCond, NULL);
+
+    if (pthread_create(&result->thread, NULL, WriterThread, result) != 0)
+    {
+        printf("gou_screenshot_writer_create: pthread_create failed.\n");
+        abort();
+    }
+
+    return result;
+}
+
+void gou_screenshot_writer_destroy(gou_screenshot_writer_t* writer)
+{
+    pthread_mutex_lock(&writer->mutex);
+    writer->terminating = true;
+    pthread_cond_signal(&writer->jobCond);
+    pthread_mutex_unlock(&writer->mutex);
+
+    pthread_join(writer->thread, NULL);
+
+    pthread_cond_destroy(&writer->idleCond);
+    pthread_cond_destroy(&writer->jobCond);
+    pthread_mutex_destroy(&writer->mutex);
+
+    delete writer->jobs;
+
+    free(writer);
+}
+
+bool gou_screenshot_writer_submit(gou_screenshot_writer_t* writer, gou_surface_t* surface, gou_surface_pool_t* pool, const char* filename,
+    uint64_t capture)
+{
+    pthread_mutex_lock(&writer->mutex);
+
+    if (writer->pending >= writer->maxPending)
+    {
+        pthread_mutex_unlock(&writer->mutex);
+        return false;
+    }
+
+    screenshot_job_t job;
+    job.surface = surface;
+    job.pool = pool;
+    job.filename = strdup(filename);
+    job.capture = capture;
+
+    writer->jobs->push(job);
+    ++writer->pending;
+
+    pthread_cond_signal(&writer->jobCond);
+    pthread_mutex_unlock(&writer->mutex);
+
+    return true;
+}
+
+void gou_screenshot_writer_flush(gou_screenshot_writer_t* writer)
+{
+    pthread_mutex_lock(&writer->mutex);
+
+    while (writer->pending > 0)
+    {
+        pthread_cond_wait(&writer->idleCond, &writer->mutex);
+    }
+
+    pthread_mutex_unlock(&writer->mutex);
+}
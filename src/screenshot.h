@@ -0,0 +1,51 @@
+#pragma once
+
+/*
+libgou - Support library for the ODROID-GO Ultra
+Copyright (C) 2022 OtherCrashOverride
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "surface.h"
+#include "surface_pool.h"
+
+
+// Encodes captured XBGR8888 surfaces to PNG files on a background thread.
+// Each surface is released to its pool once written.
+typedef struct gou_screenshot_writer gou_screenshot_writer_t;
+
+// Captures are queued without waiting, so the writer thread calls this
+// before reading a surface. It returns once the capture has finished.
+typedef void (*gou_screenshot_wait_t)(gou_display_t* display, uint64_t capture);
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+gou_screenshot_writer_t* gou_screenshot_writer_create(int maxPending, gou_display_t* display, gou_screenshot_wait_t wait);
+// Writes everything still queued before returning
+void gou_screenshot_writer_destroy(gou_screenshot_writer_t* writer);
+// Takes ownership of surface. Returns false, leaving surface with the
+// caller, when maxPending screenshots are already queued.
+bool gou_screenshot_writer_submit(gou_screenshot_writer_t* writer, gou_surface_t* surface, gou_surface_pool_t* pool, const char* filename,
+    uint64_t capture);
+void gou_screenshot_writer_flush(gou_screenshot_writer_t* writer);
+
+
+#ifdef __cplusplus
+}
+#endif
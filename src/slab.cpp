@@ -0,0 +1,208 @@
+/*
+libgou - Support library for the ODROID-GO Ultra
+Copyright (C) 2022 OtherCrashOverride
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "slab.h"
+
+#include <map>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <drm/drm_fourcc.h>
+
+
+#define ALIGN(val, align)	(((val) + (align) - 1) & ~((align) - 1))
+
+// Matches the stride alignment used by gou_surface_create
+#define SLAB_ALIGNMENT (64)
+
+
+typedef struct gou_slab
+{
+    gou_surface_t* backing;
+    int size;
+    int freeBytes;
+    std::map<int, int>* freeRanges;   // offset -> length
+    std::map<gou_surface_t*, std::pair<int, int> >* views;    // view -> (offset, length)
+    pthread_mutex_t mutex;
+} gou_slab_t;
+
+
+// Must be called with the slab mutex held
+static int AllocRange(gou_slab_t* slab, int length)
+{
+    for (std::map<int, int>::iterator it = slab->freeRanges->begin(); it != slab->freeRanges->end(); ++it)
+    {
+        if (it->second >= length)
+        {
+            const int offset = it->first;
+            const int remaining = it->second - length;
+
+            slab->freeRanges->erase(it);
+            if (remaining > 0)
+            {
+                (*slab->freeRanges)[offset + length] = remaining;
+            }
+
+            slab->freeBytes -= length;
+            return offset;
+        }
+    }
+
+    return -1;
+}
+
+// Must be called with the slab mutex held
+static void FreeRange(gou_slab_t* slab, int offset, int length)
+{
+    slab->freeBytes += length;
+
+    std::map<int, int>::iterator next = slab->freeRanges->lower_bound(offset);
+
+    // Coalesce with the following range
+    if (next != slab->freeRanges->end() && offset + length == next->first)
+    {
+        length += next->second;
+        next = slab->freeRanges->erase(next);
+    }
+
+    // Coalesce with the preceding range
+    if (next != slab->freeRanges->begin())
+    {
+        std::map<int, int>::iterator prev = next;
+        --prev;
+
+        if (prev->first + prev->second == offset)
+        {
+            prev->second += length;
+            return;
+        }
+    }
+
+    (*slab->freeRanges)[offset] = length;
+}
+
+
+gou_slab_t* gou_slab_create(gou_display_t* display, int size)
+{
+    gou_slab_t* result = (gou_slab_t*)malloc(sizeof(gou_slab_t));
+    if (!result)
+    {
+        printf("malloc failed.\n");
+        abort();
+    }
+
+    memset(result, 0, sizeof(*result));
+
+    // The backing store is a single row of bytes
+    size = ALIGN(size, SLAB_ALIGNMENT);
+    result->backing = gou_surface_create(display, size, 1, DRM_FORMAT_R8);
+    result->size = gou_surface_stride_get(result->backing);
+    result->freeBytes = result->size;
+
+    result->freeRanges = new std::map<int, int>;
+    (*result->freeRanges)[0] = result->size;
+
+    result->views = new std::map<gou_surface_t*, std::pair<int, int> >;
+
+    pthread_mutex_init(&result->mutex, NULL);
+
+    return result;
+}
+
+void gou_slab_destroy(gou_slab_t* slab)
+{
+    if (!slab->views->empty())
+    {
+        printf("gou_slab_destroy: %d surfaces still allocated.\n", (int)slab->views->size());
+        abort();
+    }
+
+    pthread_mutex_destroy(&slab->mutex);
+
+    delete slab->views;
+    delete slab->freeRanges;
+
+    gou_surface_destroy(slab->backing);
+
+    free(slab);
+}
+
+gou_surface_t* gou_slab_surface_create(gou_slab_t* slab, int width, int height, uint32_t format)
+{
+    if (!gou_format_info_get(format))
+    {
+        return NULL;
+    }
+
+    const int stride = gou_drm_format_get_stride(format, width);
+    const int length = ALIGN(gou_drm_format_get_size(format, width, height), SLAB_ALIGNMENT);
+
+    pthread_mutex_lock(&slab->mutex);
+
+    const int offset = AllocRange(slab, length);
+    if (offset < 0)
+    {
+        pthread_mutex_unlock(&slab->mutex);
+        return NULL;
+    }
+
+    gou_surface_t* result = gou_surface_create_view(slab->backing, offset, width, height, format, stride);
+    (*slab->views)[result] = std::make_pair(offset, length);
+
+    pthread_mutex_unlock(&slab->mutex);
+
+    return result;
+}
+
+void gou_slab_surface_destroy(gou_slab_t* slab, gou_surface_t* surface)
+{
+    pthread_mutex_lock(&slab->mutex);
+
+    std::map<gou_surface_t*, std::pair<int, int> >::iterator it = slab->views->find(surface);
+    if (it == slab->views->end())
+    {
+        printf("gou_slab_surface_destroy: surface not allocated from slab.\n");
+        abort();
+    }
+
+    FreeRange(slab, it->second.first, it->second.second);
+    slab->views->erase(it);
+
+    pthread_mutex_unlock(&slab->mutex);
+
+    gou_surface_destroy(surface);
+}
+
+gou_surface_t* gou_slab_backing_get(gou_slab_t* slab)
+{
+    return slab->backing;
+}
+
+int gou_slab_size_get(gou_slab_t* slab)
+{
+    return slab->size;
+}
+
+int gou_slab_free_get(gou_slab_t* slab)
+{
+    return slab->freeBytes;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+/*
+libgou - Support library for the ODROID-GO Ultra
+Copyright (C) 2022 OtherCrashOverride
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "surface.h"
+
+
+typedef struct gou_slab gou_slab_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Carves surface views out of a single ION buffer. Views must be returned
+// with gou_slab_surface_destroy before the slab is destroyed.
+gou_slab_t* gou_slab_create(gou_display_t* display, int size);
+void gou_slab_destroy(gou_slab_t* slab);
+gou_surface_t* gou_slab_surface_create(gou_slab_t* slab, int width, int height, uint32_t format);
+void gou_slab_surface_destroy(gou_slab_t* slab, gou_surface_t* surface);
+gou_surface_t* gou_slab_backing_get(gou_slab_t* slab);
+int gou_slab_size_get(gou_slab_t* slab);
+int gou_slab_free_get(gou_slab_t* slab);
+
+
+#ifdef __cplusplus
+}
+#endif
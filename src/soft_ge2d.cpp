@@ -0,0 +1,1489 @@
+/*
+libgou - Support library for the ODROID-GO Ultra
+Copyright (C) 2022 OtherCrashOverride
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "soft_ge2d.h"
+
+#include <vector>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+
+#include <drm/drm_fourcc.h>
+#include <linux/dma-buf.h>
+
+#include "ge2d.h"
+#include "ge2d_cmd.h"
+#include "ge2d_func.h"
+#include "format.h"
+#include "convert.h"
+#include "worker_pool.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SOFT_GE2D_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SOFT_GE2D_SSE2
+#endif
+
+
+#define MAX_MAPPINGS    (16)
+
+// Destination tiles keep rotated source reads within a few cache lines
+#define TILE_SIZE       (32)
+
+// Operations smaller than this run on the calling thread
+#define PARALLEL_PIXELS (64 * 1024)
+
+
+typedef struct mapping
+{
+    int fd;
+    dev_t dev;
+    ino_t ino;
+    size_t size;
+    uint8_t* pixels;
+    uint64_t lastOperation;
+} mapping_t;
+
+typedef enum
+{
+    LAYOUT_PACKED = 0,
+    LAYOUT_NV12,
+    LAYOUT_NV21,
+    LAYOUT_YUV420
+} canvas_layout_t;
+
+typedef struct canvas
+{
+    canvas_layout_t layout;
+    const gou_format_info_t* format;
+    bool argb;              // packed ARGB8888, used without conversion
+    int bytesPerPixel;      // packed layout only
+    uint8_t* planes[3];
+    int strides[3];
+    int width;
+    int height;
+    int fd;                 // dma-buf synced for CPU access, -1 for OSD0
+    bool xRev;
+    bool yRev;
+} canvas_t;
+
+typedef struct axis_sample
+{
+    int i0;
+    int i1;
+    uint32_t frac;          // weight of i1 out of 256
+} axis_sample_t;
+
+typedef struct blend_op
+{
+    unsigned int colorMode;
+    unsigned int colorSrc;
+    unsigned int colorDst;
+    unsigned int alphaMode;
+    unsigned int alphaSrc;
+    unsigned int alphaDst;
+} blend_op_t;
+
+typedef enum
+{
+    BLEND_NONE = 0,
+    BLEND_COVERAGE,
+    BLEND_PREMULTIPLIED,
+    BLEND_GENERIC
+} blend_kind_t;
+
+typedef struct stretch_job
+{
+    const canvas_t* dst;
+    const canvas_t* src2;
+    int dstX;
+    int dstY;
+    int width;
+    int height;
+    int src2X;
+    int src2Y;
+    const uint32_t* src;    // ARGB8888 source rectangle
+    int srcStride;          // in pixels
+    const axis_sample_t* cols;  // sample for each destination column
+    const axis_sample_t* rows;  // sample for each destination row
+    bool swap;
+    bool identity;
+    blend_kind_t blend;
+    blend_op_t op;
+    uint32_t constColor;    // ARGB
+    int globalAlpha;        // -1 when disabled
+    bool opaque;
+} stretch_job_t;
+
+typedef struct fill_job
+{
+    const canvas_t* dst;
+    int x;
+    int y;
+    int width;
+    uint32_t value;         // already in the destination format
+} fill_job_t;
+
+typedef struct yuv_job
+{
+    const canvas_t* src;
+    int x;
+    int y;
+    int width;
+    uint32_t* dst;
+} yuv_job_t;
+
+typedef struct encode_job
+{
+    const canvas_t* dst;
+    int x;                  // even
+    int y;                  // even
+    int width;
+    int height;
+    const uint32_t* src;    // ARGB8888, width pixels per row
+} encode_job_t;
+
+typedef void (*band_func_t)(const void* job, int y0, int y1);
+
+typedef struct band_task
+{
+    band_func_t func;
+    const void* job;
+    int rows;
+} band_task_t;
+
+typedef struct gou_soft_ge2d
+{
+    config_ge2d_para_ex_s config;
+    bool configured;
+    unsigned int scaleCoef;
+    uint8_t* osd;
+    int osdStride;
+    int osdWidth;
+    int osdHeight;
+    std::vector<mapping_t>* mappings;   // front = oldest
+    uint64_t operation;                 // counts drawing operations
+    std::vector<uint32_t>* decoded;     // sources that are not ARGB8888
+    std::vector<uint32_t>* staged;      // YUV destinations before encoding
+    pthread_mutex_t mutex;
+} gou_soft_ge2d_t;
+
+
+// Exact rounding of x / 255 for x <= 255 * 255
+static inline uint32_t Div255(uint32_t x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+// Two channels per multiply: 8 bit values with weights summing to 256
+// cannot carry into the neighbouring channel.
+static inline uint32_t Lerp(uint32_t a, uint32_t b, uint32_t frac)
+{
+    const uint32_t inv = 256 - frac;
+    const uint32_t rb = (((a & 0x00ff00ff) * inv + (b & 0x00ff00ff) * frac) >> 8) & 0x00ff00ff;
+    const uint32_t ag = (((a >> 8) & 0x00ff00ff) * inv + ((b >> 8) & 0x00ff00ff) * frac) & 0xff00ff00;
+
+    return rb | ag;
+}
+
+static inline uint8_t Clamp8(int value)
+{
+    return (uint8_t)(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+// RGBA as used by GE2D color registers
+static inline uint32_t RgbaToArgb(uint32_t rgba)
+{
+    return ((rgba & 0xff) << 24) | (rgba >> 8);
+}
+
+
+// Bands are whole tiles, run on the shared worker threads
+static void BandRun(const void* arg, int band, int bandCount)
+{
+    const band_task_t* task = (const band_task_t*)arg;
+
+    const int tiles = (task->rows + TILE_SIZE - 1) / TILE_SIZE;
+    const int y0 = tiles * band / bandCount * TILE_SIZE;
+    const int y1 = tiles * (band + 1) / bandCount * TILE_SIZE;
+
+    task->func(task->job, y0, (y1 < task->rows) ? y1 : task->rows);
+}
+
+static void RunBands(band_func_t func, const void* job, int rows, int pixels)
+{
+    const int tiles = (rows + TILE_SIZE - 1) / TILE_SIZE;
+    if (pixels < PARALLEL_PIXELS || tiles <= 1)
+    {
+        func(job, 0, rows);
+        return;
+    }
+
+    band_task_t task;
+    task.func = func;
+    task.job = job;
+    task.rows = rows;
+
+    gou_worker_pool_run(BandRun, &task, tiles);
+}
+
+
+// Must be called with the engine mutex held. Buffers are looked up by
+// descriptor and verified by inode so a reused fd number is remapped.
+// Mappings the current operation already resolved are never evicted.
+static uint8_t* MapFd(gou_soft_ge2d_t* engine, int fd, size_t* outSize)
+{
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        return NULL;
+    }
+
+    // dma-buf reports its size through lseek
+    const off_t size = lseek(fd, 0, SEEK_END);
+    if (size <= 0)
+    {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < engine->mappings->size(); ++i)
+    {
+        mapping_t& mapping = (*engine->mappings)[i];
+        if (mapping.fd == fd && mapping.dev == st.st_dev &&
+            mapping.ino == st.st_ino && mapping.size == (size_t)size)
+        {
+            mapping.lastOperation = engine->operation;
+
+            *outSize = mapping.size;
+            return mapping.pixels;
+        }
+    }
+
+    void* pixels = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (pixels == MAP_FAILED)
+    {
+        printf("gou_soft_ge2d: mmap failed (fd=%d).\n", fd);
+        return NULL;
+    }
+
+    if (engine->mappings->size() >= MAX_MAPPINGS)
+    {
+        std::vector<mapping_t>::iterator oldest = engine->mappings->begin();
+        while (oldest->lastOperation == engine->operation)
+        {
+            ++oldest;
+        }
+
+        munmap(oldest->pixels, oldest->size);
+
+        engine->mappings->erase(oldest);
+    }
+
+    mapping_t mapping;
+    mapping.fd = fd;
+    mapping.dev = st.st_dev;
+    mapping.ino = st.st_ino;
+    mapping.size = (size_t)size;
+    mapping.pixels = (uint8_t*)pixels;
+    mapping.lastOperation = engine->operation;
+
+    engine->mappings->push_back(mapping);
+
+    *outSize = mapping.size;
+    return mapping.pixels;
+}
+
+static void SyncCanvas(const canvas_t* canvas, uint64_t flags)
+{
+    if (canvas->fd < 0)
+    {
+        return;
+    }
+
+    // Not every exporter implements CPU access hooks
+    dma_buf_sync sync = { flags };
+    ioctl(canvas->fd, DMA_BUF_IOCTL_SYNC, &sync);
+}
+
+static bool ResolveCanvas(gou_soft_ge2d_t* engine, const src_dst_para_ex_s* para, const config_planes_ion_s* planes, canvas_t* outCanvas)
+{
+    memset(outCanvas, 0, sizeof(*outCanvas));
+    outCanvas->fd = -1;
+    outCanvas->xRev = (para->x_rev != 0);
+    outCanvas->yRev = (para->y_rev != 0);
+
+    const gou_format_info_t* info = gou_format_info_find_ge2d((uint32_t)para->format);
+    if (!info)
+    {
+        return false;
+    }
+
+    outCanvas->format = info;
+
+    if (info->yuv)
+    {
+        switch (info->drm_fourcc)
+        {
+            case DRM_FORMAT_NV12:
+                outCanvas->layout = LAYOUT_NV12;
+                break;
+
+            case DRM_FORMAT_NV21:
+                outCanvas->layout = LAYOUT_NV21;
+                break;
+
+            default:
+                // Planes are given in Y, Cb, Cr order
+                outCanvas->layout = LAYOUT_YUV420;
+                break;
+        }
+    }
+    else
+    {
+        outCanvas->layout = LAYOUT_PACKED;
+        outCanvas->bytesPerPixel = info->bpp / 8;
+        outCanvas->argb = (info->bpp == 32 && info->r.shift == 16 && info->g.shift == 8 && info->b.shift == 0);
+    }
+
+
+    if (para->mem_type == CANVAS_OSD0)
+    {
+        if (!engine->osd || !outCanvas->argb)
+        {
+            return false;
+        }
+
+        outCanvas->planes[0] = engine->osd;
+        outCanvas->strides[0] = engine->osdStride;
+        outCanvas->width = engine->osdWidth;
+        outCanvas->height = engine->osdHeight;
+
+        return true;
+    }
+
+    if (para->mem_type != CANVAS_ALLOC)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < info->plane_count; ++i)
+    {
+        size_t size;
+        uint8_t* base = MapFd(engine, planes[i].shared_fd, &size);
+        if (!base || planes[i].addr >= size)
+        {
+            return false;
+        }
+
+        // Packed plane widths are in pixels, YUV plane widths in bytes
+        const int stride = (i == 0 && !info->yuv) ? (int)planes[i].w * outCanvas->bytesPerPixel : (int)planes[i].w;
+        if (stride <= 0)
+        {
+            return false;
+        }
+
+        // Limit access to the mapped buffer
+        const int rows = (int)((size - planes[i].addr) / stride);
+
+        outCanvas->planes[i] = base + planes[i].addr;
+        outCanvas->strides[i] = stride;
+
+        if (i == 0)
+        {
+            outCanvas->width = (int)planes[i].w;
+            outCanvas->height = rows;
+        }
+        else if (rows * 2 < outCanvas->height)
+        {
+            outCanvas->height = rows * 2;
+        }
+    }
+
+    outCanvas->fd = planes[0].shared_fd;
+
+    return true;
+}
+
+static bool RectInside(const canvas_t* canvas, int x, int y, int width, int height)
+{
+    return width > 0 && height > 0 && x >= 0 && y >= 0 &&
+        x + width <= canvas->width && y + height <= canvas->height;
+}
+
+
+// BT.601 limited range, chroma taken from the top left of each 2x2 block
+static inline uint32_t YuvToArgb(int y, int u, int v)
+{
+    const int c = (y - 16) * 298 + 128;
+    const int d = u - 128;
+    const int e = v - 128;
+
+    const uint8_t r = Clamp8((c + 409 * e) >> 8);
+    const uint8_t g = Clamp8((c - 100 * d - 208 * e) >> 8);
+    const uint8_t b = Clamp8((c + 516 * d) >> 8);
+
+    return 0xff000000 | (r << 16) | (g << 8) | b;
+}
+
+static void DecodeYuvRows(const void* arg, int y0, int y1)
+{
+    const yuv_job_t* job = (const yuv_job_t*)arg;
+    const canvas_t* src = job->src;
+
+    for (int row = y0; row < y1; ++row)
+    {
+        const int y = job->y + row;
+        const uint8_t* luma = src->planes[0] + y * src->strides[0];
+        uint32_t* dst = job->dst + row * job->width;
+
+        if (src->layout == LAYOUT_YUV420)
+        {
+            const uint8_t* cb = src->planes[1] + (y / 2) * src->strides[1];
+            const uint8_t* cr = src->planes[2] + (y / 2) * src->strides[2];
+
+            for (int i = 0; i < job->width; ++i)
+            {
+                const int x = job->x + i;
+                dst[i] = YuvToArgb(luma[x], cb[x / 2], cr[x / 2]);
+            }
+        }
+        else
+        {
+            const uint8_t* chroma = src->planes[1] + (y / 2) * src->strides[1];
+            const int uOffset = (src->layout == LAYOUT_NV12) ? 0 : 1;
+
+            for (int i = 0; i < job->width; ++i)
+            {
+                const int x = job->x + i;
+                const uint8_t* pair = chroma + (x / 2) * 2;
+
+                dst[i] = YuvToArgb(luma[x], pair[uOffset], pair[1 - uOffset]);
+            }
+        }
+    }
+}
+
+// BT.601 limited range, chroma averaged over each 2x2 block
+static inline uint8_t RgbToY(int r, int g, int b)
+{
+    return (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+static void EncodeYuvRows(const void* arg, int pair0, int pair1)
+{
+    const encode_job_t* job = (const encode_job_t*)arg;
+    const canvas_t* dst = job->dst;
+
+    for (int pair = pair0; pair < pair1; ++pair)
+    {
+        const int row = pair * 2;
+        const int y = job->y + row;
+
+        // An odd last row is paired with itself
+        const uint32_t* top = job->src + row * job->width;
+        const uint32_t* bottom = (row + 1 < job->height) ? top + job->width : top;
+
+        uint8_t* luma = dst->planes[0] + y * dst->strides[0] + job->x;
+        for (int i = 0; i < job->width; ++i)
+        {
+            luma[i] = RgbToY((top[i] >> 16) & 0xff, (top[i] >> 8) & 0xff, top[i] & 0xff);
+        }
+
+        if (row + 1 < job->height)
+        {
+            luma += dst->strides[0];
+            for (int i = 0; i < job->width; ++i)
+            {
+                luma[i] = RgbToY((bottom[i] >> 16) & 0xff, (bottom[i] >> 8) & 0xff, bottom[i] & 0xff);
+            }
+        }
+
+        for (int i = 0; i < job->width; i += 2)
+        {
+            // An odd last column is paired with itself
+            const int next = (i + 1 < job->width) ? i + 1 : i;
+            const uint32_t quad[4] = { top[i], top[next], bottom[i], bottom[next] };
+
+            int r = 0;
+            int g = 0;
+            int b = 0;
+            for (int k = 0; k < 4; ++k)
+            {
+                r += (quad[k] >> 16) & 0xff;
+                g += (quad[k] >> 8) & 0xff;
+                b += quad[k] & 0xff;
+            }
+
+            r = (r + 2) / 4;
+            g = (g + 2) / 4;
+            b = (b + 2) / 4;
+
+            const uint8_t u = (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            const uint8_t v = (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+
+            const int cx = (job->x + i) / 2;
+            const int cy = y / 2;
+
+            if (dst->layout == LAYOUT_YUV420)
+            {
+                dst->planes[1][cy * dst->strides[1] + cx] = u;
+                dst->planes[2][cy * dst->strides[2] + cx] = v;
+            }
+            else
+            {
+                uint8_t* chroma = dst->planes[1] + cy * dst->strides[1] + cx * 2;
+                chroma[0] = (dst->layout == LAYOUT_NV12) ? u : v;
+                chroma[1] = (dst->layout == LAYOUT_NV12) ? v : u;
+            }
+        }
+    }
+}
+
+// Returns the source rectangle as ARGB8888, converting when required
+static const uint32_t* SourcePixels(gou_soft_ge2d_t* engine, const canvas_t* src, int x, int y, int width, int height, int* outStride)
+{
+    if (src->argb)
+    {
+        *outStride = src->strides[0] / 4;
+        return (const uint32_t*)(src->planes[0] + y * src->strides[0]) + x;
+    }
+
+    engine->decoded->resize((size_t)width * height);
+    uint32_t* dst = engine->decoded->data();
+
+    if (src->layout == LAYOUT_PACKED)
+    {
+        const uint8_t* pixels = src->planes[0] + y * src->strides[0] + x * src->bytesPerPixel;
+        gou_convert_to_argb8888(src->format, pixels, src->strides[0], dst, width * 4, width, height);
+    }
+    else
+    {
+        yuv_job_t job;
+        job.src = src;
+        job.x = x;
+        job.y = y;
+        job.width = width;
+        job.dst = dst;
+
+        RunBands(DecodeYuvRows, &job, height, width * height);
+    }
+
+    *outStride = width;
+    return dst;
+}
+
+
+static inline uint32_t EncodeComponent(uint32_t value, gou_format_component_t component)
+{
+    return component.bits ? (value >> (8 - component.bits)) << component.shift : 0;
+}
+
+static inline uint32_t EncodePixel(const gou_format_info_t* format, uint32_t argb)
+{
+    return EncodeComponent((argb >> 16) & 0xff, format->r) |
+        EncodeComponent((argb >> 8) & 0xff, format->g) |
+        EncodeComponent(argb & 0xff, format->b) |
+        EncodeComponent(argb >> 24, format->a);
+}
+
+static inline void StorePixel(uint8_t* dst, int bytesPerPixel, uint32_t value)
+{
+    switch (bytesPerPixel)
+    {
+        case 4:
+            memcpy(dst, &value, 4);
+            break;
+
+        case 3:
+            dst[0] = (uint8_t)value;
+            dst[1] = (uint8_t)(value >> 8);
+            dst[2] = (uint8_t)(value >> 16);
+            break;
+
+        case 2:
+        {
+            const uint16_t half = (uint16_t)value;
+            memcpy(dst, &half, 2);
+            break;
+        }
+
+        default:
+            dst[0] = (uint8_t)value;
+            break;
+    }
+}
+
+static void ReadRow(const canvas_t* canvas, int x, int y, int count, uint32_t* out)
+{
+    const uint8_t* src = canvas->planes[0] + y * canvas->strides[0] + x * canvas->bytesPerPixel;
+
+    if (canvas->argb)
+    {
+        memcpy(out, src, count * 4);
+    }
+    else
+    {
+        gou_convert_to_argb8888(canvas->format, src, canvas->strides[0], out, count * 4, count, 1);
+    }
+}
+
+static void WriteRow(const canvas_t* canvas, int x, int y, int count, const uint32_t* pixels)
+{
+    uint8_t* dst = canvas->planes[0] + y * canvas->strides[0] + x * canvas->bytesPerPixel;
+
+    if (canvas->argb)
+    {
+        memcpy(dst, pixels, count * 4);
+        return;
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+        StorePixel(dst + i * canvas->bytesPerPixel, canvas->bytesPerPixel, EncodePixel(canvas->format, pixels[i]));
+    }
+}
+
+
+static void FillRow32(uint32_t* dst, uint32_t value, int count)
+{
+    int i = 0;
+
+#if defined(SOFT_GE2D_NEON)
+    const uint32x4_t vector = vdupq_n_u32(value);
+    for (; i + 4 <= count; i += 4)
+    {
+        vst1q_u32(dst + i, vector);
+    }
+#elif defined(SOFT_GE2D_SSE2)
+    const __m128i vector = _mm_set1_epi32((int)value);
+    for (; i + 4 <= count; i += 4)
+    {
+        _mm_storeu_si128((__m128i*)(dst + i), vector);
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        dst[i] = value;
+    }
+}
+
+static void FillRows(const void* arg, int y0, int y1)
+{
+    const fill_job_t* job = (const fill_job_t*)arg;
+    const canvas_t* dst = job->dst;
+
+    for (int row = y0; row < y1; ++row)
+    {
+        uint8_t* pixels = dst->planes[0] + (job->y + row) * dst->strides[0] + job->x * dst->bytesPerPixel;
+
+        if (dst->bytesPerPixel == 4)
+        {
+            FillRow32((uint32_t*)pixels, job->value, job->width);
+        }
+        else
+        {
+            for (int i = 0; i < job->width; ++i)
+            {
+                StorePixel(pixels + i * dst->bytesPerPixel, dst->bytesPerPixel, job->value);
+            }
+        }
+    }
+}
+
+
+static inline uint32_t ColorFactor(unsigned int factor, uint32_t sc, uint32_t sa, uint32_t dc, uint32_t da, uint32_t kc, uint32_t ka)
+{
+    switch (factor)
+    {
+        case COLOR_FACTOR_ZERO:                 return 0;
+        case COLOR_FACTOR_ONE:                  return 255;
+        case COLOR_FACTOR_SRC_COLOR:            return sc;
+        case COLOR_FACTOR_ONE_MINUS_SRC_COLOR:  return 255 - sc;
+        case COLOR_FACTOR_DST_COLOR:            return dc;
+        case COLOR_FACTOR_ONE_MINUS_DST_COLOR:  return 255 - dc;
+        case COLOR_FACTOR_SRC_ALPHA:            return sa;
+        case COLOR_FACTOR_ONE_MINUS_SRC_ALPHA:  return 255 - sa;
+        case COLOR_FACTOR_DST_ALPHA:            return da;
+        case COLOR_FACTOR_ONE_MINUS_DST_ALPHA:  return 255 - da;
+        case COLOR_FACTOR_CONST_COLOR:          return kc;
+        case COLOR_FACTOR_ONE_MINUS_CONST_COLOR: return 255 - kc;
+        case COLOR_FACTOR_CONST_ALPHA:          return ka;
+        case COLOR_FACTOR_ONE_MINUS_CONST_ALPHA: return 255 - ka;
+        case COLOR_FACTOR_SRC_ALPHA_SATURATE:   return (sa < 255 - da) ? sa : 255 - da;
+        default:                                return 0;
+    }
+}
+
+static inline uint32_t AlphaFactor(unsigned int factor, uint32_t sa, uint32_t da, uint32_t ka)
+{
+    switch (factor)
+    {
+        case ALPHA_FACTOR_ZERO:                 return 0;
+        case ALPHA_FACTOR_ONE:                  return 255;
+        case ALPHA_FACTOR_SRC_ALPHA:            return sa;
+        case ALPHA_FACTOR_ONE_MINUS_SRC_ALPHA:  return 255 - sa;
+        case ALPHA_FACTOR_DST_ALPHA:            return da;
+        case ALPHA_FACTOR_ONE_MINUS_DST_ALPHA:  return 255 - da;
+        case ALPHA_FACTOR_CONST_ALPHA:          return ka;
+        case ALPHA_FACTOR_ONE_MINUS_CONST_ALPHA: return 255 - ka;
+        default:                                return 0;
+    }
+}
+
+static inline uint32_t Logic(unsigned int operation, uint32_t s, uint32_t d)
+{
+    uint32_t result;
+    switch (operation)
+    {
+        case LOGIC_OPERATION_CLEAR:         result = 0; break;
+        case LOGIC_OPERATION_COPY:          result = s; break;
+        case LOGIC_OPERATION_NOOP:          result = d; break;
+        case LOGIC_OPERATION_SET:           result = 0xff; break;
+        case LOGIC_OPERATION_COPY_INVERT:   result = ~s; break;
+        case LOGIC_OPERATION_INVERT:        result = ~d; break;
+        case LOGIC_OPERATION_AND_REVERSE:   result = s & ~d; break;
+        case LOGIC_OPERATION_OR_REVERSE:    result = s | ~d; break;
+        case LOGIC_OPERATION_AND:           result = s & d; break;
+        case LOGIC_OPERATION_OR:            result = s | d; break;
+        case LOGIC_OPERATION_NAND:          result = ~(s & d); break;
+        case LOGIC_OPERATION_NOR:           result = ~(s | d); break;
+        case LOGIC_OPERATION_XOR:           result = s ^ d; break;
+        case LOGIC_OPERATION_EQUIV:         result = ~(s ^ d); break;
+        case LOGIC_OPERATION_AND_INVERT:    result = ~s & d; break;
+        case LOGIC_OPERATION_OR_INVERT:     result = ~s | d; break;
+        default:                            result = s; break;
+    }
+
+    return result & 0xff;
+}
+
+static inline uint32_t Combine(unsigned int mode, uint32_t s, uint32_t fs, uint32_t d, uint32_t fd)
+{
+    if (mode >= OPERATION_LOGIC)
+    {
+        return Logic(mode - OPERATION_LOGIC, s, d);
+    }
+
+    uint32_t a;
+    uint32_t b;
+    switch (mode)
+    {
+        case OPERATION_ADD:
+            a = Div255(s * fs + d * fd);
+            return (a > 255) ? 255 : a;
+
+        case OPERATION_SUB:
+            a = Div255(s * fs);
+            b = Div255(d * fd);
+            return (a > b) ? a - b : 0;
+
+        case OPERATION_REVERSE_SUB:
+            a = Div255(s * fs);
+            b = Div255(d * fd);
+            return (b > a) ? b - a : 0;
+
+        case OPERATION_MIN:
+            a = Div255(s * fs);
+            b = Div255(d * fd);
+            return (a < b) ? a : b;
+
+        case OPERATION_MAX:
+        default:
+            a = Div255(s * fs);
+            b = Div255(d * fd);
+            return (a > b) ? a : b;
+    }
+}
+
+static uint32_t BlendPixel(const blend_op_t* op, uint32_t s, uint32_t d, uint32_t k)
+{
+    const uint32_t sa = s >> 24;
+    const uint32_t da = d >> 24;
+    const uint32_t ka = k >> 24;
+
+    uint32_t result = 0;
+    for (int shift = 0; shift < 24; shift += 8)
+    {
+        const uint32_t sc = (s >> shift) & 0xff;
+        const uint32_t dc = (d >> shift) & 0xff;
+        const uint32_t kc = (k >> shift) & 0xff;
+
+        const uint32_t fs = ColorFactor(op->colorSrc, sc, sa, dc, da, kc, ka);
+        const uint32_t fd = ColorFactor(op->colorDst, sc, sa, dc, da, kc, ka);
+
+        result |= Combine(op->colorMode, sc, fs, dc, fd) << shift;
+    }
+
+    const uint32_t fs = AlphaFactor(op->alphaSrc, sa, da, ka);
+    const uint32_t fd = AlphaFactor(op->alphaDst, sa, da, ka);
+
+    return result | (Combine(op->alphaMode, sa, fs, da, fd) << 24);
+}
+
+
+// The vector paths give the same results as BlendPixel() for the two
+// operations libgou issues. Each returns the number of pixels processed.
+#if defined(SOFT_GE2D_NEON)
+
+static inline uint8x8_t Div255Vector(uint16x8_t x)
+{
+    x = vaddq_u16(x, vdupq_n_u16(128));
+    return vshrn_n_u16(vsraq_n_u16(x, x, 8), 8);
+}
+
+static inline uint8x16_t AlphaBroadcast(uint8x16_t pixels)
+{
+    const uint32x4_t alpha = vshrq_n_u32(vreinterpretq_u32_u8(pixels), 24);
+    return vreinterpretq_u8_u32(vmulq_n_u32(alpha, 0x01010101));
+}
+
+static int BlendCoverageVector(uint32_t* pixels, const uint32_t* background, int count)
+{
+    const uint8x16_t alphaMask = vreinterpretq_u8_u32(vdupq_n_u32(0xff000000));
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const uint8x16_t s = vld1q_u8((const uint8_t*)(pixels + i));
+        const uint8x16_t d = vld1q_u8((const uint8_t*)(background + i));
+        const uint8x16_t sa = AlphaBroadcast(s);
+
+        // Colors weigh by source alpha, alpha itself by one
+        const uint8x16_t fs = vorrq_u8(sa, alphaMask);
+        const uint8x16_t fd = vmvnq_u8(sa);
+
+        uint16x8_t lo = vmull_u8(vget_low_u8(s), vget_low_u8(fs));
+        lo = vmlal_u8(lo, vget_low_u8(d), vget_low_u8(fd));
+        uint16x8_t hi = vmull_u8(vget_high_u8(s), vget_high_u8(fs));
+        hi = vmlal_u8(hi, vget_high_u8(d), vget_high_u8(fd));
+
+        vst1q_u8((uint8_t*)(pixels + i), vcombine_u8(Div255Vector(lo), Div255Vector(hi)));
+    }
+
+    return i;
+}
+
+static int BlendPremultipliedVector(uint32_t* pixels, const uint32_t* background, int count)
+{
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const uint8x16_t s = vld1q_u8((const uint8_t*)(pixels + i));
+        const uint8x16_t d = vld1q_u8((const uint8_t*)(background + i));
+        const uint8x16_t fd = vmvnq_u8(AlphaBroadcast(s));
+
+        const uint16x8_t lo = vmull_u8(vget_low_u8(d), vget_low_u8(fd));
+        const uint16x8_t hi = vmull_u8(vget_high_u8(d), vget_high_u8(fd));
+
+        vst1q_u8((uint8_t*)(pixels + i), vqaddq_u8(s, vcombine_u8(Div255Vector(lo), Div255Vector(hi))));
+    }
+
+    return i;
+}
+
+#elif defined(SOFT_GE2D_SSE2)
+
+static inline __m128i Div255Vector(__m128i x)
+{
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+// Two pixels widened to 16 bit lanes
+static inline __m128i AlphaBroadcast(__m128i pixels)
+{
+    pixels = _mm_shufflelo_epi16(pixels, _MM_SHUFFLE(3, 3, 3, 3));
+    return _mm_shufflehi_epi16(pixels, _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+static int BlendCoverageVector(uint32_t* pixels, const uint32_t* background, int count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi16(255);
+    const __m128i alphaLanes = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128i s = _mm_loadu_si128((const __m128i*)(pixels + i));
+        const __m128i d = _mm_loadu_si128((const __m128i*)(background + i));
+
+        __m128i halves[2];
+        for (int h = 0; h < 2; ++h)
+        {
+            const __m128i s16 = h ? _mm_unpackhi_epi8(s, zero) : _mm_unpacklo_epi8(s, zero);
+            const __m128i d16 = h ? _mm_unpackhi_epi8(d, zero) : _mm_unpacklo_epi8(d, zero);
+            const __m128i sa = AlphaBroadcast(s16);
+
+            // Colors weigh by source alpha, alpha itself by one
+            const __m128i fs = _mm_or_si128(_mm_andnot_si128(alphaLanes, sa), _mm_and_si128(alphaLanes, full));
+            const __m128i fd = _mm_sub_epi16(full, sa);
+
+            halves[h] = Div255Vector(_mm_add_epi16(_mm_mullo_epi16(s16, fs), _mm_mullo_epi16(d16, fd)));
+        }
+
+        _mm_storeu_si128((__m128i*)(pixels + i), _mm_packus_epi16(halves[0], halves[1]));
+    }
+
+    return i;
+}
+
+static int BlendPremultipliedVector(uint32_t* pixels, const uint32_t* background, int count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi16(255);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128i s = _mm_loadu_si128((const __m128i*)(pixels + i));
+        const __m128i d = _mm_loadu_si128((const __m128i*)(background + i));
+
+        __m128i halves[2];
+        for (int h = 0; h < 2; ++h)
+        {
+            const __m128i s16 = h ? _mm_unpackhi_epi8(s, zero) : _mm_unpacklo_epi8(s, zero);
+            const __m128i d16 = h ? _mm_unpackhi_epi8(d, zero) : _mm_unpacklo_epi8(d, zero);
+            const __m128i fd = _mm_sub_epi16(full, AlphaBroadcast(s16));
+
+            halves[h] = Div255Vector(_mm_mullo_epi16(d16, fd));
+        }
+
+        _mm_storeu_si128((__m128i*)(pixels + i), _mm_adds_epu8(s, _mm_packus_epi16(halves[0], halves[1])));
+    }
+
+    return i;
+}
+
+#else
+
+static int BlendCoverageVector(uint32_t* pixels, const uint32_t* background, int count)
+{
+    return 0;
+}
+
+static int BlendPremultipliedVector(uint32_t* pixels, const uint32_t* background, int count)
+{
+    return 0;
+}
+
+#endif
+
+static void BlendRow(const stretch_job_t* job, uint32_t* pixels, const uint32_t* background, int count)
+{
+    // The global alpha scales the per pixel alpha of the first source
+    if (job->globalAlpha >= 0)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            const uint32_t alpha = Div255((pixels[i] >> 24) * job->globalAlpha);
+            pixels[i] = (pixels[i] & 0x00ffffff) | (alpha << 24);
+        }
+    }
+
+    int i = 0;
+    switch (job->blend)
+    {
+        case BLEND_COVERAGE:
+            i = BlendCoverageVector(pixels, background, count);
+            break;
+
+        case BLEND_PREMULTIPLIED:
+            i = BlendPremultipliedVector(pixels, background, count);
+            break;
+
+        default:
+            break;
+    }
+
+    for (; i < count; ++i)
+    {
+        pixels[i] = BlendPixel(&job->op, pixels[i], background[i], job->constColor);
+    }
+}
+
+
+static inline uint32_t Sample(const uint32_t* src, int stride, const axis_sample_t& x, const axis_sample_t& y)
+{
+    const uint32_t* row0 = src + y.i0 * stride;
+
+    uint32_t top = row0[x.i0];
+    if (x.frac)
+    {
+        top = Lerp(top, row0[x.i1], x.frac);
+    }
+
+    if (!y.frac)
+    {
+        return top;
+    }
+
+    const uint32_t* row1 = src + y.i1 * stride;
+
+    uint32_t bottom = row1[x.i0];
+    if (x.frac)
+    {
+        bottom = Lerp(bottom, row1[x.i1], x.frac);
+    }
+
+    return Lerp(top, bottom, y.frac);
+}
+
+static void SampleRow(const stretch_job_t* job, int u0, int v, int count, uint32_t* out)
+{
+    if (job->identity)
+    {
+        memcpy(out, job->src + v * job->srcStride + u0, count * 4);
+        return;
+    }
+
+    const axis_sample_t& row = job->rows[v];
+
+    for (int i = 0; i < count; ++i)
+    {
+        const axis_sample_t& col = job->cols[u0 + i];
+
+        // With dst_xy_swap destination columns walk the source vertically
+        out[i] = job->swap ? Sample(job->src, job->srcStride, row, col) : Sample(job->src, job->srcStride, col, row);
+    }
+}
+
+static void StretchRows(const void* arg, int v0, int v1)
+{
+    const stretch_job_t* job = (const stretch_job_t*)arg;
+
+    uint32_t pixels[TILE_SIZE];
+    uint32_t background[TILE_SIZE];
+
+    for (int ty = v0; ty < v1; ty += TILE_SIZE)
+    {
+        const int tyEnd = (ty + TILE_SIZE < v1) ? ty + TILE_SIZE : v1;
+
+        for (int tx = 0; tx < job->width; tx += TILE_SIZE)
+        {
+            const int count = (job->width - tx < TILE_SIZE) ? job->width - tx : TILE_SIZE;
+
+            for (int v = ty; v < tyEnd; ++v)
+            {
+                SampleRow(job, tx, v, count, pixels);
+
+                if (job->blend != BLEND_NONE)
+                {
+                    ReadRow(job->src2, job->src2X + tx, job->src2Y + v, count, background);
+                    BlendRow(job, pixels, background, count);
+                }
+
+                if (job->opaque)
+                {
+                    for (int i = 0; i < count; ++i)
+                    {
+                        pixels[i] |= 0xff000000;
+                    }
+                }
+
+                WriteRow(job->dst, job->dstX + tx, job->dstY + v, count, pixels);
+            }
+        }
+    }
+}
+
+
+// Sample positions accumulate like the scaler's: the first is at the
+// 24 bit init phase, less one pixel per repeat of the first pixel, and
+// each step is the rectangle ratio truncated to 24 bits.
+static void BuildAxis(std::vector<axis_sample_t>* axis, int length, int srcLength, bool nearest, bool reverse,
+    unsigned int phase, int repeat)
+{
+    axis->resize(length);
+
+    const int64_t ONE = 1 << 24;
+    const int64_t step = ((int64_t)srcLength << 24) / length;
+
+    for (int i = 0; i < length; ++i)
+    {
+        int64_t position = (int64_t)(phase & (ONE - 1)) - repeat * ONE + i * step;
+        if (position < 0) position = 0;
+
+        int index = (int)(position >> 24);
+
+        axis_sample_t sample;
+        sample.frac = nearest ? 0 : (uint32_t)(position >> 16) & 0xff;
+
+        if (index >= srcLength - 1)
+        {
+            index = srcLength - 1;
+            sample.frac = 0;
+        }
+
+        sample.i0 = index;
+        sample.i1 = sample.frac ? index + 1 : index;
+
+        if (reverse)
+        {
+            sample.i0 = srcLength - 1 - sample.i0;
+            sample.i1 = srcLength - 1 - sample.i1;
+        }
+
+        (*axis)[i] = sample;
+    }
+}
+
+static blend_kind_t ClassifyBlend(unsigned int op, blend_op_t* outOp)
+{
+    outOp->colorMode = (op >> 24) & 0xff;
+    outOp->colorSrc = (op >> 20) & 0xf;
+    outOp->colorDst = (op >> 16) & 0xf;
+    outOp->alphaMode = (op >> 8) & 0xff;
+    outOp->alphaSrc = (op >> 4) & 0xf;
+    outOp->alphaDst = op & 0xf;
+
+    if (op == blendop(BLENDOP_ADD, COLOR_FACTOR_SRC_ALPHA, COLOR_FACTOR_ONE_MINUS_SRC_ALPHA,
+                      BLENDOP_ADD, ALPHA_FACTOR_ONE, ALPHA_FACTOR_ONE_MINUS_SRC_ALPHA))
+    {
+        return BLEND_COVERAGE;
+    }
+
+    if (op == blendop(BLENDOP_ADD, COLOR_FACTOR_ONE, COLOR_FACTOR_ONE_MINUS_SRC_ALPHA,
+                      BLENDOP_ADD, ALPHA_FACTOR_ONE, ALPHA_FACTOR_ONE_MINUS_SRC_ALPHA))
+    {
+        return BLEND_PREMULTIPLIED;
+    }
+
+    return BLEND_GENERIC;
+}
+
+
+// Must be called with the engine mutex held
+static int Fill(gou_soft_ge2d_t* engine, const ge2d_para_s* para)
+{
+    const config_para_ex_ion_s& config = engine->config.para_config_memtype._ge2d_config_ex;
+
+    canvas_t dst;
+    if (!ResolveCanvas(engine, &config.dst_para, config.dst_planes, &dst) ||
+        dst.layout != LAYOUT_PACKED ||
+        !RectInside(&dst, para->src1_rect.x, para->src1_rect.y, para->src1_rect.w, para->src1_rect.h))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    fill_job_t job;
+    job.dst = &dst;
+    job.x = para->src1_rect.x;
+    job.y = para->src1_rect.y;
+    job.width = para->src1_rect.w;
+    job.value = EncodePixel(dst.format, RgbaToArgb(para->color));
+
+    SyncCanvas(&dst, DMA_BUF_SYNC_START | DMA_BUF_SYNC_WRITE);
+    RunBands(FillRows, &job, para->src1_rect.h, para->src1_rect.w * para->src1_rect.h);
+    SyncCanvas(&dst, DMA_BUF_SYNC_END | DMA_BUF_SYNC_WRITE);
+
+    return 0;
+}
+
+// Must be called with the engine mutex held
+static int Stretch(gou_soft_ge2d_t* engine, const ge2d_para_s* para, bool blend, bool opaque)
+{
+    const config_para_ex_ion_s& config = engine->config.para_config_memtype._ge2d_config_ex;
+
+    const rectangle_s& srcRect = para->src1_rect;
+    const rectangle_s& dstRect = para->dst_rect;
+
+    canvas_t src;
+    canvas_t dst;
+    canvas_t src2;
+    if (!ResolveCanvas(engine, &config.src_para, config.src_planes, &src) ||
+        !ResolveCanvas(engine, &config.dst_para, config.dst_planes, &dst) ||
+        !RectInside(&src, srcRect.x, srcRect.y, srcRect.w, srcRect.h) ||
+        !RectInside(&dst, dstRect.x, dstRect.y, dstRect.w, dstRect.h))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // YUV destinations are written whole chroma blocks at a time
+    const bool encode = (dst.layout != LAYOUT_PACKED);
+    if (encode && (blend || (dstRect.x & 1) || (dstRect.y & 1)))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // The second source is read where the destination is written
+    if (blend &&
+        (!ResolveCanvas(engine, &config.src2_para, config.src2_planes, &src2) ||
+         src2.layout != LAYOUT_PACKED ||
+         !RectInside(&src2, para->src2_rect.x, para->src2_rect.y, dstRect.w, dstRect.h)))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+
+    // With dst_xy_swap the destination width runs along the source height
+    const bool swap = (config.dst_xy_swap != 0);
+    const int lengthX = swap ? dstRect.h : dstRect.w;
+    const int lengthY = swap ? dstRect.w : dstRect.h;
+
+    std::vector<axis_sample_t> axisX;
+    std::vector<axis_sample_t> axisY;
+    BuildAxis(&axisX, lengthX, srcRect.w, config.src1_hsc_phase0_always_en != 0, src.xRev,
+        config.hf_init_phase, config.hf_rpt_num);
+    BuildAxis(&axisY, lengthY, srcRect.h, config.src1_vsc_phase0_always_en != 0, src.yRev,
+        config.vf_init_phase, config.vf_rpt_num);
+
+    // Destination mirroring selects which sample each output pixel takes
+    std::vector<axis_sample_t> cols(dstRect.w);
+    std::vector<axis_sample_t> rows(dstRect.h);
+
+    for (int u = 0; u < dstRect.w; ++u)
+    {
+        const int index = dst.xRev ? dstRect.w - 1 - u : u;
+        cols[u] = swap ? axisY[index] : axisX[index];
+    }
+
+    for (int v = 0; v < dstRect.h; ++v)
+    {
+        const int index = dst.yRev ? dstRect.h - 1 - v : v;
+        rows[v] = swap ? axisX[index] : axisY[index];
+    }
+
+
+    SyncCanvas(&src, DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ);
+    if (blend)
+    {
+        SyncCanvas(&src2, DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ);
+    }
+    SyncCanvas(&dst, DMA_BUF_SYNC_START | DMA_BUF_SYNC_WRITE);
+
+
+    // YUV output is staged as ARGB8888 then encoded
+    canvas_t staged;
+    if (encode)
+    {
+        engine->staged->resize((size_t)dstRect.w * dstRect.h);
+
+        memset(&staged, 0, sizeof(staged));
+        staged.layout = LAYOUT_PACKED;
+        staged.format = gou_format_info_get(DRM_FORMAT_ARGB8888);
+        staged.argb = true;
+        staged.bytesPerPixel = 4;
+        staged.planes[0] = (uint8_t*)engine->staged->data();
+        staged.strides[0] = dstRect.w * 4;
+        staged.width = dstRect.w;
+        staged.height = dstRect.h;
+        staged.fd = -1;
+    }
+
+    stretch_job_t job;
+    memset(&job, 0, sizeof(job));
+
+    job.dst = encode ? &staged : &dst;
+    job.src2 = blend ? &src2 : NULL;
+    job.dstX = encode ? 0 : dstRect.x;
+    job.dstY = encode ? 0 : dstRect.y;
+    job.width = dstRect.w;
+    job.height = dstRect.h;
+    job.src2X = para->src2_rect.x;
+    job.src2Y = para->src2_rect.y;
+    job.src = SourcePixels(engine, &src, srcRect.x, srcRect.y, srcRect.w, srcRect.h, &job.srcStride);
+    job.cols = cols.data();
+    job.rows = rows.data();
+    job.swap = swap;
+    job.identity = !swap && !src.xRev && !src.yRev && !dst.xRev && !dst.yRev &&
+        srcRect.w == dstRect.w && srcRect.h == dstRect.h;
+    job.blend = blend ? ClassifyBlend((unsigned int)para->op, &job.op) : BLEND_NONE;
+    job.constColor = RgbaToArgb((uint32_t)config.alu_const_color);
+    job.globalAlpha = (blend && config.src1_gb_alpha_en) ? (int)(config.src1_gb_alpha & 0xff) : -1;
+    job.opaque = opaque;
+
+    RunBands(StretchRows, &job, dstRect.h, dstRect.w * dstRect.h);
+
+    if (encode)
+    {
+        encode_job_t encodeJob;
+        encodeJob.dst = &dst;
+        encodeJob.x = dstRect.x;
+        encodeJob.y = dstRect.y;
+        encodeJob.width = dstRect.w;
+        encodeJob.height = dstRect.h;
+        encodeJob.src = engine->staged->data();
+
+        RunBands(EncodeYuvRows, &encodeJob, (dstRect.h + 1) / 2, dstRect.w * dstRect.h);
+    }
+
+
+    SyncCanvas(&dst, DMA_BUF_SYNC_END | DMA_BUF_SYNC_WRITE);
+    if (blend)
+    {
+        SyncCanvas(&src2, DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ);
+    }
+    SyncCanvas(&src, DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ);
+
+    return 0;
+}
+
+
+gou_soft_ge2d_t* gou_soft_ge2d_create()
+{
+    gou_soft_ge2d_t* result = (gou_soft_ge2d_t*)malloc(sizeof(gou_soft_ge2d_t));
+    if (!result)
+    {
+        printf("malloc failed.\n");
+        abort();
+    }
+
+    memset(result, 0, sizeof(*result));
+
+    // The driver starts every context with bilinear scaler coefficients
+    result->scaleCoef = FILTER_TYPE_BILINEAR;
+    result->mappings = new std::vector<mapping_t>;
+    result->decoded = new std::vector<uint32_t>;
+    result->staged = new std::vector<uint32_t>;
+
+    pthread_mutex_init(&result->mutex, NULL);
+
+    return result;
+}
+
+void gou_soft_ge2d_destroy(gou_soft_ge2d_t* engine)
+{
+    for (size_t i = 0; i < engine->mappings->size(); ++i)
+    {
+        const mapping_t& mapping = (*engine->mappings)[i];
+        munmap(mapping.pixels, mapping.size);
+    }
+
+    pthread_mutex_destroy(&engine->mutex);
+
+    delete engine->staged;
+    delete engine->decoded;
+    delete engine->mappings;
+
+    free(engine);
+}
+
+void gou_soft_ge2d_osd_set(gou_soft_ge2d_t* engine, void* pixels, int stride, int width, int height)
+{
+    pthread_mutex_lock(&engine->mutex);
+
+    engine->osd = (uint8_t*)pixels;
+    engine->osdStride = stride;
+    engine->osdWidth = width;
+    engine->osdHeight = height;
+
+    pthread_mutex_unlock(&engine->mutex);
+}
+
+int gou_soft_ge2d_ioctl(gou_soft_ge2d_t* engine, unsigned long request, void* arg)
+{
+    int result = 0;
+
+    pthread_mutex_lock(&engine->mutex);
+
+    // Operations complete before returning so NOBLOCK variants are synchronous
+    switch (request)
+    {
+        case GE2D_CONFIG_EX_MEM:
+            memcpy(&engine->config, arg, sizeof(engine->config));
+            engine->configured = true;
+            break;
+
+        case GE2D_SET_COEF:
+            // Bicubic and the other FIR sets are approximated by bilinear
+            engine->scaleCoef = (unsigned int)(uintptr_t)arg & 0xffff;
+            break;
+
+        case GE2D_FILLRECTANGLE:
+        case GE2D_FILLRECTANGLE_NOBLOCK:
+        case GE2D_BLIT:
+        case GE2D_BLIT_NOBLOCK:
+        case GE2D_BLIT_NOALPHA:
+        case GE2D_BLIT_NOALPHA_NOBLOCK:
+        case GE2D_STRETCHBLIT:
+        case GE2D_STRETCHBLIT_NOBLOCK:
+        case GE2D_STRETCHBLIT_NOALPHA:
+        case GE2D_STRETCHBLIT_NOALPHA_NOBLOCK:
+        case GE2D_BLEND:
+        case GE2D_BLEND_NOBLOCK:
+        case GE2D_BLEND_NOALPHA:
+        case GE2D_BLEND_NOALPHA_NOBLOCK:
+        {
+            if (!engine->configured)
+            {
+                errno = EINVAL;
+                result = -1;
+                break;
+            }
+
+            ++engine->operation;
+
+            const bool opaque = (request == GE2D_BLIT_NOALPHA || request == GE2D_BLIT_NOALPHA_NOBLOCK ||
+                request == GE2D_STRETCHBLIT_NOALPHA || request == GE2D_STRETCHBLIT_NOALPHA_NOBLOCK ||
+                request == GE2D_BLEND_NOALPHA || request == GE2D_BLEND_NOALPHA_NOBLOCK);
+
+            ge2d_para_s para = *(const ge2d_para_s*)arg;
+
+            if (request == GE2D_FILLRECTANGLE || request == GE2D_FILLRECTANGLE_NOBLOCK)
+            {
+                result = Fill(engine, &para);
+            }
+            else if (request == GE2D_BLEND || request == GE2D_BLEND_NOBLOCK ||
+                     request == GE2D_BLEND_NOALPHA || request == GE2D_BLEND_NOALPHA_NOBLOCK)
+            {
+                result = Stretch(engine, &para, true, opaque);
+            }
+            else
+            {
+                // Unscaled blits take their size from the source
+                if (request != GE2D_STRETCHBLIT && request != GE2D_STRETCHBLIT_NOBLOCK &&
+                    request != GE2D_STRETCHBLIT_NOALPHA && request != GE2D_STRETCHBLIT_NOALPHA_NOBLOCK)
+                {
+                    const bool swap = (engine->config.para_config_memtype._ge2d_config_ex.dst_xy_swap != 0);
+                    para.dst_rect.w = swap ? para.src1_rect.h : para.src1_rect.w;
+                    para.dst_rect.h = swap ? para.src1_rect.w : para.src1_rect.h;
+                }
+
+                result = Stretch(engine, &para, false, opaque);
+            }
+            break;
+        }
+
+        default:
+            errno = ENOTTY;
+            result = -1;
+            break;
+    }
+
+    pthread_mutex_unlock(&engine->mutex);
+
+    return result;
+}
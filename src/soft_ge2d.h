@@ -0,0 +1,52 @@
+#pragma once
+
+/*
+libgou - Support library for the ODROID-GO Ultra
+Copyright (C) 2022 OtherCrashOverride
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stdint.h>
+
+
+// A CPU implementation of the GE2D ioctls libgou issues: fill, blit,
+// stretchblit (with x_rev, y_rev and dst_xy_swap) and blend, reading every
+// source format in the format table. It backs displays without a 2D engine
+// and gives deterministic output to compare the hardware against.
+//
+// It is a reference, not bit exact: sample positions follow the programmed
+// phases and 24 bit step, but bilinear weights have 8 bits, the bicubic and
+// other FIR coefficient sets are treated as bilinear, and blending rounds
+// with an exact divide by 255. Compare blended or filtered output with a
+// tolerance; fills and unscaled copies should match exactly.
+typedef struct gou_soft_ge2d gou_soft_ge2d_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+gou_soft_ge2d_t* gou_soft_ge2d_create();
+void gou_soft_ge2d_destroy(gou_soft_ge2d_t* engine);
+// Memory addressed by CANVAS_OSD0
+void gou_soft_ge2d_osd_set(gou_soft_ge2d_t* engine, void* pixels, int stride, int width, int height);
+// Same contract as ioctl(2) on /dev/ge2d: returns -1 and sets errno on failure
+int gou_soft_ge2d_ioctl(gou_soft_ge2d_t* engine, unsigned long request, void* arg);
+
+
+#ifdef __cplusplus
+}
+#endif
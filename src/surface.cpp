@@ -19,6 +19,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include "surface.h"
 
+#include <atomic>
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <sys/types.h>
@@ -29,10 +31,14 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #include <unistd.h>
 #include <pthread.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
 
 #include <drm/drm_fourcc.h>
+#include <linux/dma-buf.h>
 
-#include "ion.h"
+#include "allocator.h"
+#include "format.h"
 
 
 #define ALIGN(val, align)	(((val) + (align) - 1) & ~((align) - 1))
@@ -44,45 +50,181 @@ typedef struct gou_surface
     int width;
     int height;
     uint32_t format;
+    const gou_format_info_t* format_info;
     int stride;
     int size;
-    uint32_t ion_handle;;
+    int buffer_size;
+    int plane_count;
+    int plane_offset[GOU_SURFACE_MAX_PLANES];
+    int plane_stride[GOU_SURFACE_MAX_PLANES];
+    uint32_t flags;
+    gou_allocator_t allocator;
+    const gou_allocator_backend_t* backend;     // NULL for imported buffers
+    uint64_t handle;
     int share_fd;
     void* map;
+    gou_surface_t* parent;  // views share the parent's buffer
+    int offset;
+    gou_surface_t* prev;    // live surface list
+    gou_surface_t* next;
 } go2_surface_t;
 
 
-static int ion_fd = -1;
+static pthread_mutex_t statsMutex = PTHREAD_MUTEX_INITIALIZER;
+static gou_surface_stats_t stats;
+static gou_surface_t* liveSurfaces = NULL;
+static bool leakReportRegistered = false;
+static std::atomic<uint32_t> shareFdGeneration(0);
 
 
-gou_surface_t* gou_surface_create(gou_display_t* display, int width, int height, uint32_t format)
+static uint64_t MicrosecondsGet()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void RecordLatency(gou_surface_op_t op, uint64_t startUs)
+{
+    const uint64_t elapsed = MicrosecondsGet() - startUs;
+
+    // Bucket n counts durations below 2^n microseconds
+    int bucket = 0;
+    while (bucket < GOU_SURFACE_LATENCY_BUCKETS - 1 && (elapsed >> bucket) != 0)
+    {
+        ++bucket;
+    }
+
+    pthread_mutex_lock(&statsMutex);
+
+    gou_surface_latency_t& latency = stats.latency[op];
+    ++latency.count;
+    latency.total_us += elapsed;
+    if (elapsed > latency.max_us) latency.max_us = elapsed;
+    ++latency.buckets[bucket];
+
+    pthread_mutex_unlock(&statsMutex);
+}
+
+static void LeakReportAtExit()
+{
+    gou_surface_leak_report();
+}
+
+// Adds an allocated or imported surface to the accounting
+static void TrackSurface(gou_surface_t* surface)
 {
-    if (ion_fd < 0)
+    pthread_mutex_lock(&statsMutex);
+
+    surface->prev = NULL;
+    surface->next = liveSurfaces;
+    if (liveSurfaces) liveSurfaces->prev = surface;
+    liveSurfaces = surface;
+
+    ++stats.live_count;
+    if (stats.live_count > stats.live_count_high_water) stats.live_count_high_water = stats.live_count;
+
+    if (surface->backend)
+    {
+        stats.live_bytes += surface->buffer_size;
+        if (stats.live_bytes > stats.live_bytes_high_water) stats.live_bytes_high_water = stats.live_bytes;
+
+        size_t& bytes = stats.allocator_bytes[surface->allocator];
+        bytes += surface->buffer_size;
+        if (bytes > stats.allocator_bytes_high_water[surface->allocator]) stats.allocator_bytes_high_water[surface->allocator] = bytes;
+    }
+
+    if (!leakReportRegistered)
     {
-        ion_fd = open("/dev/ion", O_RDWR);
-        if (ion_fd < 0)
+        const char* env = getenv("GOU_SURFACE_LEAK_REPORT");
+        if (env && atoi(env))
         {
-            printf("open /dev/ion failed.\n");
-            abort();
+            atexit(LeakReportAtExit);
         }
+
+        leakReportRegistered = true;
     }
 
-    // Allocate a buffer
-    int stride = ALIGN(width * (gou_drm_format_get_bpp(format) / 8), 64);
-    int size = height * stride;
+    pthread_mutex_unlock(&statsMutex);
+}
+
+static void UntrackSurface(gou_surface_t* surface)
+{
+    pthread_mutex_lock(&statsMutex);
+
+    if (surface->prev) surface->prev->next = surface->next;
+    else liveSurfaces = surface->next;
+    if (surface->next) surface->next->prev = surface->prev;
 
-    ion_allocation_data allocation_data = { 0 };
-    allocation_data.len = size;
-    allocation_data.heap_id_mask = (1 << ION_HEAP_TYPE_DMA);
-    allocation_data.flags = 0;
+    --stats.live_count;
 
-    int io = ioctl(ion_fd, ION_IOC_ALLOC, &allocation_data);
-    if (io != 0)
+    if (surface->backend)
     {
-        printf("ION_IOC_ALLOC failed.\n");
-        abort();
+        stats.live_bytes -= surface->buffer_size;
+        stats.allocator_bytes[surface->allocator] -= surface->buffer_size;
+    }
+
+    pthread_mutex_unlock(&statsMutex);
+}
+
+
+// Computes plane offsets and strides from the plane 0 stride. Returns the
+// total size in bytes.
+static int ComputeLayout(uint32_t format, int height, int stride, int* outPlaneCount, int* outOffsets, int* outStrides)
+{
+    const int chromaHeight = (height + 1) / 2;
+
+    int planeCount;
+    int size;
+
+    outOffsets[0] = 0;
+    outStrides[0] = stride;
+
+    switch (format)
+    {
+        case DRM_FORMAT_NV12:
+        case DRM_FORMAT_NV21:
+            // Interleaved CbCr at half vertical resolution
+            planeCount = 2;
+            outOffsets[1] = stride * height;
+            outStrides[1] = stride;
+            size = outOffsets[1] + outStrides[1] * chromaHeight;
+            break;
+
+        case DRM_FORMAT_YUV420:
+        case DRM_FORMAT_YVU420:
+            planeCount = 3;
+            outOffsets[1] = stride * height;
+            outStrides[1] = stride / 2;
+            outOffsets[2] = outOffsets[1] + outStrides[1] * chromaHeight;
+            outStrides[2] = stride / 2;
+            size = outOffsets[2] + outStrides[2] * chromaHeight;
+            break;
+
+        default:
+            planeCount = 1;
+            size = stride * height;
+            break;
+    }
+
+    if (outPlaneCount) *outPlaneCount = planeCount;
+
+    return size;
+}
+
+
+// Returns NULL for unsupported formats
+static go2_surface_t* NewSurface(gou_display_t* display, int width, int height, uint32_t format, int stride)
+{
+    const gou_format_info_t* info = gou_format_info_get(format);
+    if (!info)
+    {
+        printf("gou_surface: unsupported format (drm_fourcc=%c%c%c%c).\n",
+            format & 0xff, format >> 8 & 0xff, format >> 16 & 0xff, format >> 24);
+        return NULL;
     }
-    
+
     go2_surface_t* result = (go2_surface_t*)malloc(sizeof(go2_surface_t));
     if (!result)
     {
@@ -96,31 +238,191 @@ gou_surface_t* gou_surface_create(gou_display_t* display, int width, int height,
     result->width = width;
     result->height = height;
     result->format = format;
-    result->size = size;
+    result->format_info = info;
     result->stride = stride;
-    result->ion_handle = allocation_data.handle;
+    result->size = ComputeLayout(format, height, stride, &result->plane_count, result->plane_offset, result->plane_stride);
     result->share_fd = -1;
     result->map = MAP_FAILED;
 
     return result;
 }
 
-void gou_surface_destroy(gou_surface_t* surface)
+// Returns the mapping of the whole underlying buffer
+static uint8_t* MapBuffer(gou_surface_t* surface)
 {
-    if (surface->share_fd >= 0) close(surface->share_fd);
+    if (surface->map == MAP_FAILED)
+    {
+        int share_fd = gou_surface_share_fd(surface);
 
-    if (surface->map) munmap(surface->map, surface->size);
+        uint64_t start = MicrosecondsGet();
+        surface->map = mmap(NULL, surface->buffer_size, PROT_READ | PROT_WRITE, MAP_SHARED, share_fd, 0);
+        if (surface->map == MAP_FAILED)
+        {
+            printf("mmap failed.\n");
+            abort();
+        }
+
+        RecordLatency(GOU_SURFACE_OP_MAP, start);
+    }
+
+    return (uint8_t*)surface->map;
+}
+
+
+gou_surface_t* gou_surface_create(gou_display_t* display, int width, int height, uint32_t format)
+{
+    return gou_surface_create_ex(display, width, height, format, GOU_SURFACE_FLAG_NONE);
+}
+
+uint32_t gou_surface_flags_resolve(uint32_t flags)
+{
+    gou_allocator_t allocator = (gou_allocator_t)((flags & GOU_SURFACE_FLAG_ALLOCATOR_MASK) >> 8);
+    if (allocator == GOU_ALLOCATOR_AUTO)
+    {
+        allocator = gou_allocator_default_get();
+    }
 
-    ion_handle_data ionHandleData = { 0 };
-    ionHandleData.handle = surface->ion_handle;
+    // These backends only provide cached memory
+    if (allocator == GOU_ALLOCATOR_DMA_HEAP_SYSTEM || allocator == GOU_ALLOCATOR_MEMFD)
+    {
+        flags |= GOU_SURFACE_FLAG_CACHED;
+    }
+
+    return (flags & ~GOU_SURFACE_FLAG_ALLOCATOR_MASK) | GOU_SURFACE_FLAG_ALLOCATOR(allocator);
+}
+
+gou_surface_t* gou_surface_create_ex(gou_display_t* display, int width, int height, uint32_t format, uint32_t flags)
+{
+    flags = gou_surface_flags_resolve(flags);
+
+    const gou_allocator_t allocator = (gou_allocator_t)((flags & GOU_SURFACE_FLAG_ALLOCATOR_MASK) >> 8);
+
+    const gou_allocator_backend_t* backend = gou_allocator_backend_get(allocator);
 
-    int io = ioctl(ion_fd, ION_IOC_FREE, &ionHandleData);
-    if (io != 0)
+    go2_surface_t* result = NewSurface(display, width, height, format, gou_drm_format_get_stride(format, width));
+    if (!result) return NULL;
+
+    // Allocate a buffer
+    uint64_t start = MicrosecondsGet();
+    if (!backend->alloc(result->size, (flags & GOU_SURFACE_FLAG_CACHED) != 0, &result->handle))
     {
-        printf("ION_IOC_FREE failed.\n");
+        printf("gou_surface_create: %s allocation failed (size=%d).\n", backend->name, result->size);
+
+        pthread_mutex_lock(&statsMutex);
+        ++stats.allocation_failures;
+        pthread_mutex_unlock(&statsMutex);
+
+        gou_surface_leak_report();
         abort();
     }
 
+    RecordLatency(GOU_SURFACE_OP_ALLOCATE, start);
+
+    result->buffer_size = result->size;
+    result->flags = flags;
+    result->allocator = allocator;
+    result->backend = backend;
+
+    TrackSurface(result);
+
+    return result;
+}
+
+gou_surface_t* gou_surface_create_view(gou_surface_t* parent, int offset, int width, int height, uint32_t format, int stride)
+{
+    // Views refer directly to the backing buffer with an absolute offset
+    offset += parent->offset;
+    if (parent->parent)
+    {
+        parent = parent->parent;
+    }
+
+    go2_surface_t* result = NewSurface(parent->display, width, height, format, stride);
+    if (!result) return NULL;
+
+    if (offset < 0 || offset + result->size > parent->buffer_size)
+    {
+        printf("gou_surface_create_view: view exceeds parent (offset=%d, size=%d, parent size=%d).\n",
+            offset, result->size, parent->buffer_size);
+        abort();
+    }
+
+    result->buffer_size = parent->buffer_size;
+    result->flags = parent->flags;
+    result->allocator = parent->allocator;
+    result->parent = parent;
+    result->offset = offset;
+
+    return result;
+}
+
+gou_surface_t* gou_surface_import_fd(gou_display_t* display, int fd, int width, int height, uint32_t format, int stride, int offset)
+{
+    go2_surface_t* result = NewSurface(display, width, height, format, stride);
+    if (!result) return NULL;
+
+    // The caller keeps ownership of fd
+    result->share_fd = dup(fd);
+    if (result->share_fd < 0)
+    {
+        printf("gou_surface_import_fd: dup failed.\n");
+        abort();
+    }
+
+    // dma-buf reports its size through lseek
+    off_t length = lseek(result->share_fd, 0, SEEK_END);
+    if (length < 0)
+    {
+        length = offset + result->size;
+    }
+    else
+    {
+        lseek(result->share_fd, 0, SEEK_SET);
+    }
+
+    if (offset < 0 || offset + result->size > length)
+    {
+        printf("gou_surface_import_fd: surface exceeds buffer (offset=%d, size=%d, buffer size=%d).\n",
+            offset, result->size, (int)length);
+        abort();
+    }
+
+    result->buffer_size = (int)length;
+    result->offset = offset;
+
+    // How the exporter maps the buffer is unknown, so CPU access is
+    // always bracketed with DMA_BUF_IOCTL_SYNC
+    result->flags = GOU_SURFACE_FLAG_CACHED;
+
+    TrackSurface(result);
+
+    return result;
+}
+
+void gou_surface_destroy(gou_surface_t* surface)
+{
+    if (surface->parent)
+    {
+        free(surface);
+        return;
+    }
+
+    UntrackSurface(surface);
+
+    // Changed before the number can be handed out again
+    if (surface->share_fd >= 0)
+    {
+        shareFdGeneration.fetch_add(1);
+        close(surface->share_fd);
+    }
+
+    if (surface->map != MAP_FAILED) munmap(surface->map, surface->buffer_size);
+
+    if (surface->backend)
+    {
+        surface->backend->free(surface->handle);
+    }
+
     free(surface);
 }
 
@@ -139,31 +441,96 @@ uint32_t gou_surface_format_get(gou_surface_t* surface)
     return surface->format;
 }
 
+const gou_format_info_t* gou_surface_format_info_get(gou_surface_t* surface)
+{
+    return surface->format_info;
+}
+
 int gou_surface_stride_get(gou_surface_t* surface)
 {
     return surface->stride;
 }
 
+int gou_surface_offset_get(gou_surface_t* surface)
+{
+    return surface->offset;
+}
+
+int gou_surface_size_get(gou_surface_t* surface)
+{
+    return surface->size;
+}
+
+int gou_surface_plane_count_get(gou_surface_t* surface)
+{
+    return surface->plane_count;
+}
+
+int gou_surface_plane_offset_get(gou_surface_t* surface, int plane)
+{
+    if (plane < 0 || plane >= surface->plane_count)
+    {
+        printf("gou_surface_plane_offset_get: invalid plane (%d).\n", plane);
+        abort();
+    }
+
+    return surface->plane_offset[plane];
+}
+
+int gou_surface_plane_stride_get(gou_surface_t* surface, int plane)
+{
+    if (plane < 0 || plane >= surface->plane_count)
+    {
+        printf("gou_surface_plane_stride_get: invalid plane (%d).\n", plane);
+        abort();
+    }
+
+    return surface->plane_stride[plane];
+}
+
+uint32_t gou_surface_flags_get(gou_surface_t* surface)
+{
+    return surface->flags;
+}
+
+gou_allocator_t gou_surface_allocator_get(gou_surface_t* surface)
+{
+    return surface->allocator;
+}
+
 gou_display_t* gou_surface_display_get(gou_surface_t* surface)
 {
     return surface->display;
 }
 
+gou_surface_t* gou_surface_parent_get(gou_surface_t* surface)
+{
+    return surface->parent;
+}
+
+bool gou_surface_imported_get(gou_surface_t* surface)
+{
+    return !surface->parent && !surface->backend;
+}
+
 int gou_surface_share_fd(gou_surface_t* surface)
 {
-    if (surface->share_fd <= 0)
+    if (surface->parent)
     {
-        ion_fd_data ionData = { 0 };
-        ionData.handle = surface->ion_handle;
+        return gou_surface_share_fd(surface->parent);
+    }
 
-        int io = ioctl(ion_fd, ION_IOC_SHARE, &ionData);
-        if (io != 0)
+    if (surface->share_fd < 0)
+    {
+        uint64_t start = MicrosecondsGet();
+        surface->share_fd = surface->backend->share(surface->handle);
+        if (surface->share_fd < 0)
         {
-            printf("ION_IOC_SHARE failed.\n");
+            printf("gou_surface_share_fd: %s share failed.\n", surface->backend->name);
             abort();
         }
 
-        surface->share_fd = ionData.fd;
+        RecordLatency(GOU_SURFACE_OP_SHARE, start);
     }
 
     return surface->share_fd;
@@ -171,96 +538,165 @@ int gou_surface_share_fd(gou_surface_t* surface)
 
 void* gou_surface_map(gou_surface_t* surface)
 {
-   if (surface->map == MAP_FAILED)
-   {
-        int share_fd = gou_surface_share_fd(surface);
-        surface->map = mmap(NULL, surface->size, PROT_READ | PROT_WRITE, MAP_SHARED, share_fd, 0);
-        if (surface->map == MAP_FAILED)
-        {
-            printf("mmap failed.\n");
-            abort();
-        }
-   }
+    gou_surface_t* root = surface->parent ? surface->parent : surface;
 
-   return surface->map;
+    return MapBuffer(root) + surface->offset;
 }
 
 void gou_surface_unmap(gou_surface_t* surface)
 {
-    if (surface->map != MAP_FAILED)
+    // The parent owns the mapping of a view
+    if (surface->map != MAP_FAILED && !surface->parent)
     {
-        munmap(surface->map, surface->size);
+        munmap(surface->map, surface->buffer_size);
         surface->map = MAP_FAILED;
     }
 }
 
+static bool IsEmptyRect(const gou_rect_t* rect)
+{
+    return rect && (rect->width <= 0 || rect->height <= 0);
+}
 
-
-int gou_drm_format_get_bpp(uint32_t format)
+static void SyncCpuAccess(gou_surface_t* surface, uint64_t flags, gou_surface_access_t access)
 {
-    int result;
+    int share_fd = gou_surface_share_fd(surface);
+
+    dma_buf_sync sync = { 0 };
+    sync.flags = flags;
+    if (access & GOU_SURFACE_ACCESS_READ) sync.flags |= DMA_BUF_SYNC_READ;
+    if (access & GOU_SURFACE_ACCESS_WRITE) sync.flags |= DMA_BUF_SYNC_WRITE;
 
-    switch(format)
+    int io = ioctl(share_fd, DMA_BUF_IOCTL_SYNC, &sync);
+    if (io == 0) return;
+
+    if (errno != ENOTTY && errno != EINVAL)
     {
-        case DRM_FORMAT_XRGB4444:
-        case DRM_FORMAT_XBGR4444:
-        case DRM_FORMAT_RGBX4444:
-        case DRM_FORMAT_BGRX4444:
-
-        case DRM_FORMAT_ARGB4444:
-        case DRM_FORMAT_ABGR4444:
-        case DRM_FORMAT_RGBA4444:
-        case DRM_FORMAT_BGRA4444:
-
-        case DRM_FORMAT_XRGB1555:
-        case DRM_FORMAT_XBGR1555:
-        case DRM_FORMAT_RGBX5551:
-        case DRM_FORMAT_BGRX5551:
-
-        case DRM_FORMAT_ARGB1555:
-        case DRM_FORMAT_ABGR1555:
-        case DRM_FORMAT_RGBA5551:
-        case DRM_FORMAT_BGRA5551:
-
-        case DRM_FORMAT_RGB565:
-        case DRM_FORMAT_BGR565:
-            result = 16;
-            break;
-            
+        printf("DMA_BUF_IOCTL_SYNC failed.\n");
+        abort();
+    }
 
-        case DRM_FORMAT_RGB888:
-        case DRM_FORMAT_BGR888:
-            result = 24;
-            break;
+    // Older ION exporters lack dma-buf CPU access hooks
+    if (surface->backend && surface->backend->cpu_sync)
+    {
+        surface->backend->cpu_sync(share_fd, (flags & DMA_BUF_SYNC_END) == 0,
+            (access & GOU_SURFACE_ACCESS_READ) != 0, (access & GOU_SURFACE_ACCESS_WRITE) != 0);
+    }
+}
+
+void gou_surface_begin_cpu_access(gou_surface_t* surface, gou_surface_access_t access, const gou_rect_t* rect)
+{
+    // Uncached mappings are always coherent
+    if ((surface->flags & GOU_SURFACE_FLAG_CACHED) == 0) return;
+    if (IsEmptyRect(rect)) return;
 
+    // Cache maintenance is performed on the whole buffer
+    SyncCpuAccess(surface->parent ? surface->parent : surface, DMA_BUF_SYNC_START, access);
+}
 
-        case DRM_FORMAT_XRGB8888:
-        case DRM_FORMAT_XBGR8888:
-        case DRM_FORMAT_RGBX8888:
-        case DRM_FORMAT_BGRX8888:
+void gou_surface_end_cpu_access(gou_surface_t* surface, gou_surface_access_t access, const gou_rect_t* dirty)
+{
+    if ((surface->flags & GOU_SURFACE_FLAG_CACHED) == 0) return;
 
-        case DRM_FORMAT_ARGB8888:
-        case DRM_FORMAT_ABGR8888:
-        case DRM_FORMAT_RGBA8888:
-        case DRM_FORMAT_BGRA8888:
+    // Nothing was written, so there is nothing to clean
+    if (IsEmptyRect(dirty)) access = (gou_surface_access_t)(access & ~GOU_SURFACE_ACCESS_WRITE);
+    if (access == 0) return;
 
-        case DRM_FORMAT_XRGB2101010:
-        case DRM_FORMAT_XBGR2101010:
-        case DRM_FORMAT_RGBX1010102:
-        case DRM_FORMAT_BGRX1010102:
+    SyncCpuAccess(surface->parent ? surface->parent : surface, DMA_BUF_SYNC_END, access);
+}
 
-        case DRM_FORMAT_ARGB2101010:
-        case DRM_FORMAT_ABGR2101010:
-        case DRM_FORMAT_RGBA1010102:
-        case DRM_FORMAT_BGRA1010102:
-            result = 32;
-            break;
 
+void gou_surface_stats_get(gou_surface_stats_t* outStats)
+{
+    pthread_mutex_lock(&statsMutex);
+    *outStats = stats;
+    pthread_mutex_unlock(&statsMutex);
+}
 
-        default:
-            printf("unhandled DRM FORMAT.\n");
-            result = 0;
+void gou_surface_stats_reset()
+{
+    pthread_mutex_lock(&statsMutex);
+
+    // Live totals are kept; high-water marks restart from them
+    memset(stats.latency, 0, sizeof(stats.latency));
+    stats.allocation_failures = 0;
+    stats.live_count_high_water = stats.live_count;
+    stats.live_bytes_high_water = stats.live_bytes;
+    memcpy(stats.allocator_bytes_high_water, stats.allocator_bytes, sizeof(stats.allocator_bytes));
+
+    pthread_mutex_unlock(&statsMutex);
+}
+
+int gou_surface_leak_report()
+{
+    pthread_mutex_lock(&statsMutex);
+
+    printf("gou_surface: %d live surfaces, %zu bytes (high water %d surfaces, %zu bytes)\n",
+        stats.live_count, stats.live_bytes, stats.live_count_high_water, stats.live_bytes_high_water);
+
+    for (int i = GOU_ALLOCATOR_AUTO + 1; i < GOU_ALLOCATOR_MAX; ++i)
+    {
+        if (stats.allocator_bytes_high_water[i] == 0) continue;
+
+        printf("  %s: %zu bytes (high water %zu bytes)\n", gou_allocator_name_get((gou_allocator_t)i),
+            stats.allocator_bytes[i], stats.allocator_bytes_high_water[i]);
+    }
+
+    for (gou_surface_t* surface = liveSurfaces; surface; surface = surface->next)
+    {
+        const uint32_t f = surface->format;
+        printf("  surface %p: %dx%d %c%c%c%c, %d bytes, %s\n", (void*)surface,
+            surface->width, surface->height, f & 0xff, f >> 8 & 0xff, f >> 16 & 0xff, f >> 24,
+            surface->buffer_size, surface->backend ? surface->backend->name : "imported");
     }
 
+    const int result = stats.live_count;
+
+    pthread_mutex_unlock(&statsMutex);
+
     return result;
 }
+
+
+int gou_drm_format_get_bpp(uint32_t format)
+{
+    const gou_format_info_t* info = gou_format_info_get(format);
+    if (!info)
+    {
+        printf("unhandled DRM FORMAT.\n");
+        return 0;
+    }
+
+    return info->bpp;
+}
+
+int gou_drm_format_get_stride(uint32_t format, int width)
+{
+    // Plane 0 of the YUV formats is 8bit luma
+    if (gou_drm_format_get_plane_count(format) > 1)
+    {
+        return ALIGN(width, 64);
+    }
+
+    return ALIGN(width * (gou_drm_format_get_bpp(format) / 8), 64);
+}
+
+int gou_drm_format_get_size(uint32_t format, int width, int height)
+{
+    int planeOffsets[GOU_SURFACE_MAX_PLANES];
+    int planeStrides[GOU_SURFACE_MAX_PLANES];
+
+    return ComputeLayout(format, height, gou_drm_format_get_stride(format, width), NULL, planeOffsets, planeStrides);
+}
+
+int gou_drm_format_get_plane_count(uint32_t format)
+{
+    const gou_format_info_t* info = gou_format_info_get(format);
+
+    return info ? info->plane_count : 1;
+}
+
+uint32_t gou_surface_share_fd_generation_get()
+{
+    return shareFdGeneration.load();
+}
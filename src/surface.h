@@ -20,33 +20,125 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 */
 
 #include "display.h"
+#include "allocator.h"
+#include "format.h"
 
 #include <stdint.h>
 
 
 typedef struct gou_surface gou_surface_t;
 
+typedef enum gou_surface_flags
+{
+    GOU_SURFACE_FLAG_NONE = 0,
+
+    // CPU mappings are cached; accesses must be bracketed with
+    // gou_surface_begin_cpu_access/gou_surface_end_cpu_access
+    GOU_SURFACE_FLAG_CACHED = (1 << 0),
+
+    GOU_SURFACE_FLAG_ALLOCATOR_MASK = (0xff << 8)
+} gou_surface_flags_t;
+
+// Selects the allocator backend instead of gou_allocator_default_get()
+#define GOU_SURFACE_FLAG_ALLOCATOR(allocator) ((uint32_t)(allocator) << 8)
+
+#define GOU_SURFACE_MAX_PLANES (3)
+
+typedef enum gou_surface_access
+{
+    GOU_SURFACE_ACCESS_READ = (1 << 0),
+    GOU_SURFACE_ACCESS_WRITE = (1 << 1),
+    GOU_SURFACE_ACCESS_READ_WRITE = (GOU_SURFACE_ACCESS_READ | GOU_SURFACE_ACCESS_WRITE)
+} gou_surface_access_t;
+
+// Bucket n counts operations that took less than 2^n microseconds; the
+// last bucket also counts everything slower.
+#define GOU_SURFACE_LATENCY_BUCKETS (20)
+
+typedef enum gou_surface_op
+{
+    GOU_SURFACE_OP_ALLOCATE = 0,
+    GOU_SURFACE_OP_SHARE,
+    GOU_SURFACE_OP_MAP,
+
+    GOU_SURFACE_OP_MAX
+} gou_surface_op_t;
+
+typedef struct gou_surface_latency
+{
+    uint64_t count;
+    uint64_t total_us;
+    uint64_t max_us;
+    uint64_t buckets[GOU_SURFACE_LATENCY_BUCKETS];
+} gou_surface_latency_t;
+
+// Counts allocated and imported surfaces; views are not counted.
+// Byte totals only include memory owned by an allocator backend.
+typedef struct gou_surface_stats
+{
+    int live_count;
+    int live_count_high_water;
+    size_t live_bytes;
+    size_t live_bytes_high_water;
+    size_t allocator_bytes[GOU_ALLOCATOR_MAX];
+    size_t allocator_bytes_high_water[GOU_ALLOCATOR_MAX];
+    uint64_t allocation_failures;
+    gou_surface_latency_t latency[GOU_SURFACE_OP_MAX];
+} gou_surface_stats_t;
+
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 gou_surface_t* gou_surface_create(gou_display_t* display, int width, int height, uint32_t format);
+gou_surface_t* gou_surface_create_ex(gou_display_t* display, int width, int height, uint32_t format, uint32_t flags);
+// Imported surfaces report GOU_SURFACE_FLAG_CACHED: CPU access must be
+// bracketed since the exporter's caching is unknown
+gou_surface_t* gou_surface_import_fd(gou_display_t* display, int fd, int width, int height, uint32_t format, int stride, int offset);
+gou_surface_t* gou_surface_create_view(gou_surface_t* parent, int offset, int width, int height, uint32_t format, int stride);
 void gou_surface_destroy(gou_surface_t* surface);
 int gou_surface_width_get(gou_surface_t* surface);
 int gou_surface_height_get(gou_surface_t* surface);
 uint32_t gou_surface_format_get(gou_surface_t* surface);
+const gou_format_info_t* gou_surface_format_info_get(gou_surface_t* surface);
 int gou_surface_stride_get(gou_surface_t* surface);
+int gou_surface_offset_get(gou_surface_t* surface);
+int gou_surface_size_get(gou_surface_t* surface);
+int gou_surface_plane_count_get(gou_surface_t* surface);
+int gou_surface_plane_offset_get(gou_surface_t* surface, int plane);
+int gou_surface_plane_stride_get(gou_surface_t* surface, int plane);
+uint32_t gou_surface_flags_get(gou_surface_t* surface);
+// The flags gou_surface_create_ex gives a new surface: the allocator is
+// resolved and backends that only provide cached memory set CACHED
+uint32_t gou_surface_flags_resolve(uint32_t flags);
+gou_allocator_t gou_surface_allocator_get(gou_surface_t* surface);    // GOU_ALLOCATOR_AUTO if imported
 gou_display_t* gou_surface_display_get(gou_surface_t* surface);
+gou_surface_t* gou_surface_parent_get(gou_surface_t* surface);      // NULL unless a view
+bool gou_surface_imported_get(gou_surface_t* surface);
 int gou_surface_share_fd(gou_surface_t* surface);
+// Changes whenever a share fd is closed. State keyed by fd numbers is
+// stale once it changes, as the number may now refer to another buffer.
+uint32_t gou_surface_share_fd_generation_get();
 void* gou_surface_map(gou_surface_t* surface);
 void gou_surface_unmap(gou_surface_t* surface);
+void gou_surface_begin_cpu_access(gou_surface_t* surface, gou_surface_access_t access, const gou_rect_t* rect);
+void gou_surface_end_cpu_access(gou_surface_t* surface, gou_surface_access_t access, const gou_rect_t* dirty);
 // void gou_surface_blit(gou_surface_t* srcSurface, int srcX, int srcY, int srcWidth, int srcHeight,
 //                       gou_surface_t* dstSurface, int dstX, int dstY, int dstWidth, int dstHeight,
 //                       gou_rotation_t rotation);
 // int gou_surface_save_as_png(gou_surface_t* surface, const char* filename);
+void gou_surface_stats_get(gou_surface_stats_t* outStats);
+void gou_surface_stats_reset();
+
+// Prints live surfaces and returns their count. Runs automatically at exit
+// when GOU_SURFACE_LEAK_REPORT=1.
+int gou_surface_leak_report();
 
 int gou_drm_format_get_bpp(uint32_t format);
+int gou_drm_format_get_stride(uint32_t format, int width);
+int gou_drm_format_get_size(uint32_t format, int width, int height);
+int gou_drm_format_get_plane_count(uint32_t format);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,244 @@
+/*
+libgou - Support library for the ODROID-GO Ultra
+Copyright (C) 2022 OtherCrashOverride
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "surface_pool.h"
+
+#include <list>
+#include <vector>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+
+typedef struct pool_entry
+{
+    int width;
+    int height;
+    uint32_t format;
+    int stride;
+    uint32_t flags;
+    size_t size;
+    gou_surface_t* surface;
+} pool_entry_t;
+
+typedef struct gou_surface_pool
+{
+    gou_display_t* display;
+    size_t budget;
+    size_t cachedBytes;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    std::list<pool_entry_t>* entries;   // front = most recently released
+    pthread_mutex_t mutex;
+} gou_surface_pool_t;
+
+
+// Must be called with the pool mutex held. The evicted surfaces are
+// destroyed by the caller once the mutex is released, since freeing can
+// take a while.
+static void Evict(gou_surface_pool_t* pool, size_t budget, std::vector<gou_surface_t*>* outEvicted)
+{
+    while (pool->cachedBytes > budget && !pool->entries->empty())
+    {
+        pool_entry_t& entry = pool->entries->back();
+
+        pool->cachedBytes -= entry.size;
+        ++pool->evictions;
+
+        outEvicted->push_back(entry.surface);
+        pool->entries->pop_back();
+    }
+}
+
+static void DestroyEvicted(const std::vector<gou_surface_t*>& evicted)
+{
+    for (size_t i = 0; i < evicted.size(); ++i)
+    {
+        gou_surface_destroy(evicted[i]);
+    }
+}
+
+
+gou_surface_pool_t* gou_surface_pool_create(gou_display_t* display, size_t budget)
+{
+    gou_surface_pool_t* result = (gou_surface_pool_t*)malloc(sizeof(gou_surface_pool_t));
+    if (!result)
+    {
+        printf("malloc failed.\n");
+        abort();
+    }
+
+    memset(result, 0, sizeof(*result));
+
+    result->display = display;
+    result->budget = budget;
+    result->entries = new std::list<pool_entry_t>;
+
+    pthread_mutex_init(&result->mutex, NULL);
+
+    return result;
+}
+
+void gou_surface_pool_destroy(gou_surface_pool_t* pool)
+{
+    gou_surface_pool_trim(pool);
+
+    pthread_mutex_destroy(&pool->mutex);
+
+    delete pool->entries;
+
+    free(pool);
+}
+
+gou_surface_t* gou_surface_pool_acquire(gou_surface_pool_t* pool, int width, int height, uint32_t format)
+{
+    return gou_surface_pool_acquire_ex(pool, width, height, format, GOU_SURFACE_FLAG_NONE);
+}
+
+gou_surface_t* gou_surface_pool_acquire_ex(gou_surface_pool_t* pool, int width, int height, uint32_t format, uint32_t flags)
+{
+    const int stride = gou_drm_format_get_stride(format, width);
+
+    // Compared with what a new surface would get, including the allocator
+    const uint32_t resolvedFlags = gou_surface_flags_resolve(flags);
+
+    pthread_mutex_lock(&pool->mutex);
+
+    for (std::list<pool_entry_t>::iterator it = pool->entries->begin(); it != pool->entries->end(); ++it)
+    {
+        if (it->width == width && it->height == height &&
+            it->format == format && it->stride == stride && it->flags == resolvedFlags)
+        {
+            gou_surface_t* result = it->surface;
+
+            pool->cachedBytes -= it->size;
+            ++pool->hits;
+
+            pool->entries->erase(it);
+
+            pthread_mutex_unlock(&pool->mutex);
+            return result;
+        }
+    }
+
+    ++pool->misses;
+
+    pthread_mutex_unlock(&pool->mutex);
+
+
+    gou_surface_t* result = gou_surface_create_ex(pool->display, width, height, format, flags);
+
+    // Export now so the fd is already cached when the surface is recycled
+    if (result)
+    {
+        gou_surface_share_fd(result);
+    }
+
+    return result;
+}
+
+void gou_surface_pool_release(gou_surface_pool_t* pool, gou_surface_t* surface)
+{
+    // Only buffers the pool could have allocated are kept: a view may
+    // outlive its parent and an import never matches an acquire
+    if (gou_surface_parent_get(surface) ||
+        gou_surface_imported_get(surface) ||
+        gou_surface_display_get(surface) != pool->display)
+    {
+        gou_surface_destroy(surface);
+        return;
+    }
+
+    pool_entry_t entry;
+    entry.width = gou_surface_width_get(surface);
+    entry.height = gou_surface_height_get(surface);
+    entry.format = gou_surface_format_get(surface);
+    entry.stride = gou_surface_stride_get(surface);
+    entry.flags = gou_surface_flags_get(surface);
+    entry.size = gou_surface_size_get(surface);
+    entry.surface = surface;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    if (entry.size > pool->budget)
+    {
+        ++pool->evictions;
+        pthread_mutex_unlock(&pool->mutex);
+
+        gou_surface_destroy(surface);
+        return;
+    }
+
+    pool->entries->push_front(entry);
+    pool->cachedBytes += entry.size;
+
+    std::vector<gou_surface_t*> evicted;
+    Evict(pool, pool->budget, &evicted);
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    DestroyEvicted(evicted);
+}
+
+void gou_surface_pool_trim(gou_surface_pool_t* pool)
+{
+    std::vector<gou_surface_t*> evicted;
+
+    pthread_mutex_lock(&pool->mutex);
+    Evict(pool, 0, &evicted);
+    pthread_mutex_unlock(&pool->mutex);
+
+    DestroyEvicted(evicted);
+}
+
+size_t gou_surface_pool_budget_get(gou_surface_pool_t* pool)
+{
+    return pool->budget;
+}
+
+void gou_surface_pool_budget_set(gou_surface_pool_t* pool, size_t value)
+{
+    std::vector<gou_surface_t*> evicted;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    pool->budget = value;
+    Evict(pool, pool->budget, &evicted);
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    DestroyEvicted(evicted);
+}
+
+void gou_surface_pool_stats_get(gou_surface_pool_t* pool, gou_surface_pool_stats_t* outStats)
+{
+    pthread_mutex_lock(&pool->mutex);
+
+    outStats->hits = pool->hits;
+    outStats->misses = pool->misses;
+    outStats->evictions = pool->evictions;
+    outStats->cached_count = (int)pool->entries->size();
+    outStats->cached_bytes = pool->cachedBytes;
+    outStats->budget = pool->budget;
+
+    pthread_mutex_unlock(&pool->mutex);
+}
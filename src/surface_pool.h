@@ -0,0 +1,63 @@
+#pragma once
+
+/*
+libgou - Support library for the ODROID-GO Ultra
+Copyright (C) 2022 OtherCrashOverride
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "surface.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+typedef struct gou_surface_pool gou_surface_pool_t;
+
+typedef struct gou_surface_pool_stats
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    int cached_count;
+    size_t cached_bytes;
+    size_t budget;
+} gou_surface_pool_stats_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Idle surfaces are kept (with their share fd and mapping) until the
+// byte budget is exceeded, then the least recently released are destroyed.
+gou_surface_pool_t* gou_surface_pool_create(gou_display_t* display, size_t budget);
+void gou_surface_pool_destroy(gou_surface_pool_t* pool);
+gou_surface_t* gou_surface_pool_acquire(gou_surface_pool_t* pool, int width, int height, uint32_t format);
+// Only idle surfaces created with the same flags are reused
+gou_surface_t* gou_surface_pool_acquire_ex(gou_surface_pool_t* pool, int width, int height, uint32_t format, uint32_t flags);
+// Views, imported surfaces and surfaces of another display are destroyed
+// rather than kept
+void gou_surface_pool_release(gou_surface_pool_t* pool, gou_surface_t* surface);
+void gou_surface_pool_trim(gou_surface_pool_t* pool);
+size_t gou_surface_pool_budget_get(gou_surface_pool_t* pool);
+void gou_surface_pool_budget_set(gou_surface_pool_t* pool, size_t value);
+void gou_surface_pool_stats_get(gou_surface_pool_t* pool, gou_surface_pool_stats_t* outStats);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,273 @@
+/*
+libgou - Support library for the ODROID-GO Ultra
+Copyright (C) 2022 OtherCrashOverride
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "virtual_fb.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+
+#include <linux/fb.h>
+
+#include "osd.h"
+
+
+typedef struct gou_virtual_fb
+{
+    int fd;
+    void* map;
+    size_t size;
+    int refreshRate;
+    uint64_t vblankPeriodNs;
+    uint64_t epochNs;
+    uint64_t flipCount;
+    fb_var_screeninfo var_info;
+    fb_fix_screeninfo fix_info;
+    pthread_mutex_t mutex;
+} gou_virtual_fb_t;
+
+
+static uint64_t NanosecondsGet()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Sleeps until the next tick of the synthetic vblank clock
+static void WaitForVBlank(gou_virtual_fb_t* fb)
+{
+    const uint64_t now = NanosecondsGet();
+    const uint64_t next = fb->epochNs + ((now - fb->epochNs) / fb->vblankPeriodNs + 1) * fb->vblankPeriodNs;
+
+    timespec ts;
+    ts.tv_sec = next / 1000000000;
+    ts.tv_nsec = next % 1000000000;
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+    {
+    }
+}
+
+static bool ValidateVar(gou_virtual_fb_t* fb, const fb_var_screeninfo* var_info)
+{
+    // Only the virtual height and the pan offset may change
+    if (var_info->xres != fb->var_info.xres || var_info->yres != fb->var_info.yres ||
+        var_info->xres_virtual != fb->var_info.xres_virtual ||
+        var_info->bits_per_pixel != fb->var_info.bits_per_pixel)
+    {
+        return false;
+    }
+
+    if (var_info->yres_virtual < var_info->yres ||
+        (size_t)var_info->yres_virtual * fb->fix_info.line_length > fb->size)
+    {
+        return false;
+    }
+
+    return var_info->yoffset + var_info->yres <= var_info->yres_virtual;
+}
+
+
+gou_virtual_fb_t* gou_virtual_fb_create(int width, int height, int maxBuffers, int refreshRate)
+{
+    gou_virtual_fb_t* result = (gou_virtual_fb_t*)malloc(sizeof(gou_virtual_fb_t));
+    if (!result)
+    {
+        printf("malloc failed.\n");
+        abort();
+    }
+
+    memset(result, 0, sizeof(*result));
+
+    if (refreshRate < 1) refreshRate = 60;
+    if (maxBuffers < 2) maxBuffers = 2;
+
+    const int stride = width * 4;
+    result->size = (size_t)stride * height * maxBuffers;
+
+    result->fd = memfd_create("gou_virtual_fb", MFD_CLOEXEC);
+    if (result->fd < 0)
+    {
+        printf("memfd_create failed.\n");
+        abort();
+    }
+
+    if (ftruncate(result->fd, result->size) != 0)
+    {
+        printf("ftruncate failed.\n");
+        abort();
+    }
+
+    result->map = mmap(NULL, result->size, PROT_READ | PROT_WRITE, MAP_SHARED, result->fd, 0);
+    if (result->map == MAP_FAILED)
+    {
+        printf("mmap failed.\n");
+        abort();
+    }
+
+
+    // Start double buffered with a layout matching the OSD driver
+    fb_var_screeninfo& var_info = result->var_info;
+    var_info.xres = width;
+    var_info.yres = height;
+    var_info.xres_virtual = width;
+    var_info.yres_virtual = height * 2;
+    var_info.bits_per_pixel = 32;
+    var_info.red = { 16, 8, 0 };
+    var_info.green = { 8, 8, 0 };
+    var_info.blue = { 0, 8, 0 };
+    var_info.transp = { 24, 8, 0 };
+
+    // pixclock is in picoseconds; no blanking so one frame is xres * yres pixels
+    var_info.pixclock = (uint32_t)(1000000000000ULL / ((uint64_t)refreshRate * width * height));
+
+    fb_fix_screeninfo& fix_info = result->fix_info;
+    strncpy(fix_info.id, "gou_virtual_fb", sizeof(fix_info.id) - 1);
+    fix_info.smem_len = result->size;
+    fix_info.type = FB_TYPE_PACKED_PIXELS;
+    fix_info.visual = FB_VISUAL_TRUECOLOR;
+    fix_info.ypanstep = 1;
+    fix_info.line_length = stride;
+
+    result->refreshRate = refreshRate;
+    result->vblankPeriodNs = 1000000000ULL / refreshRate;
+    result->epochNs = NanosecondsGet();
+
+    pthread_mutex_init(&result->mutex, NULL);
+
+    return result;
+}
+
+void gou_virtual_fb_destroy(gou_virtual_fb_t* fb)
+{
+    pthread_mutex_destroy(&fb->mutex);
+
+    munmap(fb->map, fb->size);
+    close(fb->fd);
+
+    free(fb);
+}
+
+int gou_virtual_fb_ioctl(gou_virtual_fb_t* fb, unsigned long request, void* arg)
+{
+    switch (request)
+    {
+        case FBIOGET_VSCREENINFO:
+            pthread_mutex_lock(&fb->mutex);
+            *(fb_var_screeninfo*)arg = fb->var_info;
+            pthread_mutex_unlock(&fb->mutex);
+            return 0;
+
+        case FBIOGET_FSCREENINFO:
+            *(fb_fix_screeninfo*)arg = fb->fix_info;
+            return 0;
+
+        case FBIOPUT_VSCREENINFO:
+        case FBIOPAN_DISPLAY:
+        {
+            const fb_var_screeninfo* var_info = (const fb_var_screeninfo*)arg;
+
+            pthread_mutex_lock(&fb->mutex);
+
+            if (!ValidateVar(fb, var_info))
+            {
+                pthread_mutex_unlock(&fb->mutex);
+
+                errno = EINVAL;
+                return -1;
+            }
+
+            const bool flip = (var_info->yoffset != fb->var_info.yoffset);
+
+            fb->var_info.yres_virtual = var_info->yres_virtual;
+
+            pthread_mutex_unlock(&fb->mutex);
+
+
+            // Like the OSD driver, a mode set latches the new offset on vblank
+            // while a pan takes effect immediately
+            if (flip && request == FBIOPUT_VSCREENINFO)
+            {
+                WaitForVBlank(fb);
+            }
+
+            pthread_mutex_lock(&fb->mutex);
+
+            fb->var_info.yoffset = var_info->yoffset;
+            if (flip) ++fb->flipCount;
+
+            pthread_mutex_unlock(&fb->mutex);
+            return 0;
+        }
+
+        case FBIO_WAITFORVSYNC:
+            WaitForVBlank(fb);
+            return 0;
+
+        case FBIOGET_OSD_DMABUF:
+        {
+            // The memfd stands in for a dma-buf of all framebuffer memory
+            const int fd = fcntl(fb->fd, F_DUPFD_CLOEXEC, 0);
+            if (fd < 0)
+            {
+                return -1;
+            }
+
+            ((fb_dmabuf_export*)arg)->fd = fd;
+            return 0;
+        }
+
+        default:
+            errno = ENOTTY;
+            return -1;
+    }
+}
+
+int gou_virtual_fb_fd_get(gou_virtual_fb_t* fb)
+{
+    return fb->fd;
+}
+
+void* gou_virtual_fb_map_get(gou_virtual_fb_t* fb)
+{
+    return fb->map;
+}
+
+int gou_virtual_fb_refresh_rate_get(gou_virtual_fb_t* fb)
+{
+    return fb->refreshRate;
+}
+
+uint64_t gou_virtual_fb_flip_count_get(gou_virtual_fb_t* fb)
+{
+    pthread_mutex_lock(&fb->mutex);
+    uint64_t result = fb->flipCount;
+    pthread_mutex_unlock(&fb->mutex);
+
+    return result;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+/*
+libgou - Support library for the ODROID-GO Ultra
+Copyright (C) 2022 OtherCrashOverride
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stdint.h>
+
+
+// A headless stand-in for /dev/fb0. Flip buffers live in a memfd and the
+// fbdev ioctls used by the display are emulated, with vblank driven by a
+// synthetic clock at the configured refresh rate.
+typedef struct gou_virtual_fb gou_virtual_fb_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+gou_virtual_fb_t* gou_virtual_fb_create(int width, int height, int maxBuffers, int refreshRate);
+void gou_virtual_fb_destroy(gou_virtual_fb_t* fb);
+// Same contract as ioctl(2): returns -1 and sets errno on failure
+int gou_virtual_fb_ioctl(gou_virtual_fb_t* fb, unsigned long request, void* arg);
+int gou_virtual_fb_fd_get(gou_virtual_fb_t* fb);
+void* gou_virtual_fb_map_get(gou_virtual_fb_t* fb);
+int gou_virtual_fb_refresh_rate_get(gou_virtual_fb_t* fb);
+uint64_t gou_virtual_fb_flip_count_get(gou_virtual_fb_t* fb);
+
+
+#ifdef __cplusplus
+}
+#endif
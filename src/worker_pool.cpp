@@ -0,0 +1,166 @@
+/*
+libgou - Support library for the ODROID-GO Ultra
+Copyright (C) 2022 OtherCrashOverride
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "worker_pool.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+
+
+#define MAX_WORKERS     (4)
+
+
+static pthread_mutex_t workerMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t workerCond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t doneCond = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t submitMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t startOnce = PTHREAD_ONCE_INIT;
+static int workerCount = 0;
+static gou_worker_pool_func_t currentFunc = NULL;
+static const void* currentJob = NULL;
+static uint32_t jobGeneration = 0;
+static int bandCount = 0;
+static int pendingBands = 0;
+
+// Set on workers and on a thread running a job, so nested jobs run inline
+static __thread bool inJob = false;
+
+
+static void* WorkerThread(void* arg)
+{
+    const int band = (int)(intptr_t)arg;
+    uint32_t generation = 0;
+
+    inJob = true;
+
+    pthread_mutex_lock(&workerMutex);
+
+    while (true)
+    {
+        while (jobGeneration == generation)
+        {
+            pthread_cond_wait(&workerCond, &workerMutex);
+        }
+
+        generation = jobGeneration;
+        const gou_worker_pool_func_t func = currentFunc;
+        const void* job = currentJob;
+        const int count = bandCount;
+
+        pthread_mutex_unlock(&workerMutex);
+
+        // Jobs using fewer bands leave the remaining workers idle
+        if (band < count)
+        {
+            func(job, band, count);
+        }
+
+        pthread_mutex_lock(&workerMutex);
+
+        if (--pendingBands == 0)
+        {
+            pthread_cond_signal(&doneCond);
+        }
+    }
+
+    return NULL;
+}
+
+static void StartWorkers()
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) cpus = 1;
+    if (cpus > MAX_WORKERS) cpus = MAX_WORKERS;
+
+    for (int i = 1; i < cpus; ++i)
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, WorkerThread, (void*)(intptr_t)i) != 0)
+        {
+            printf("gou_worker_pool: pthread_create failed.\n");
+            break;
+        }
+
+        pthread_detach(thread);
+        ++workerCount;
+    }
+}
+
+
+int gou_worker_pool_size_get()
+{
+    pthread_once(&startOnce, StartWorkers);
+
+    return workerCount + 1;
+}
+
+void gou_worker_pool_run(gou_worker_pool_func_t func, const void* job, int count)
+{
+    const int size = gou_worker_pool_size_get();
+    if (count > size)
+    {
+        count = size;
+    }
+
+    if (count <= 1 || inJob)
+    {
+        for (int band = 0; band < count; ++band)
+        {
+            func(job, band, count);
+        }
+
+        return;
+    }
+
+    pthread_mutex_lock(&submitMutex);
+    inJob = true;
+
+    pthread_mutex_lock(&workerMutex);
+
+    currentFunc = func;
+    currentJob = job;
+    bandCount = count;
+    pendingBands = workerCount;
+    ++jobGeneration;
+    pthread_cond_broadcast(&workerCond);
+
+    pthread_mutex_unlock(&workerMutex);
+
+
+    func(job, 0, count);
+
+
+    pthread_mutex_lock(&workerMutex);
+
+    while (pendingBands > 0)
+    {
+        pthread_cond_wait(&doneCond, &workerMutex);
+    }
+
+    currentFunc = NULL;
+    currentJob = NULL;
+
+    pthread_mutex_unlock(&workerMutex);
+
+    inJob = false;
+    pthread_mutex_unlock(&submitMutex);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+/*
+libgou - Support library for the ODROID-GO Ultra
+Copyright (C) 2022 OtherCrashOverride
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+// Persistent worker threads shared by the CPU paths (format conversion and
+// the software GE2D). A job is split into bands, one per thread, with the
+// calling thread taking the first band. Only one job runs at a time; a job
+// started from inside a band runs on the calling thread.
+typedef void (*gou_worker_pool_func_t)(const void* job, int band, int bandCount);
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Threads available to a job, including the calling thread
+int gou_worker_pool_size_get();
+// bandCount is clamped to gou_worker_pool_size_get()
+void gou_worker_pool_run(gou_worker_pool_func_t func, const void* job, int bandCount);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,321 @@
+/*
+libgou - Support library for the ODROID-GO Ultra
+Copyright (C) 2022 OtherCrashOverride
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+// Presents known frames and checks the pixels shown. The headless display
+// renders with the software GE2D, which is checked against pixels computed
+// here; with /dev/fb0 and /dev/ge2d present the hardware is then checked
+// against the software engine as an oracle.
+
+#include "display.h"
+#include "surface.h"
+
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <png.h>
+
+#include <drm/drm_fourcc.h>
+
+
+#define SCREENSHOT_FILE "/tmp/gou_display_test.png"
+#define PATTERN_WIDTH (100)
+#define PATTERN_HEIGHT (60)
+
+
+typedef std::vector<uint8_t> image_t;    // RGB rows of the presented frame
+
+static int failures = 0;
+
+
+static void Check(bool condition, const char* name)
+{
+    printf("%s: %s\n", condition ? "pass" : "FAIL", name);
+
+    if (!condition)
+    {
+        ++failures;
+    }
+}
+
+// Unique for every pixel of surfaces up to 256 x 256
+static uint32_t PatternColor(int x, int y)
+{
+    return 0xff000000 | (x << 16) | (y << 8) | ((x * 7 + y * 13) & 0xff);
+}
+
+static gou_surface_t* CreatePattern(gou_display_t* display, int width, int height)
+{
+    gou_surface_t* surface = gou_surface_create(display, width, height, DRM_FORMAT_XRGB8888);
+
+    gou_surface_begin_cpu_access(surface, GOU_SURFACE_ACCESS_WRITE, NULL);
+
+    uint8_t* pixels = (uint8_t*)gou_surface_map(surface);
+    for (int y = 0; y < height; ++y)
+    {
+        uint32_t* row = (uint32_t*)(pixels + y * gou_surface_stride_get(surface));
+        for (int x = 0; x < width; ++x)
+        {
+            row[x] = PatternColor(x, y);
+        }
+    }
+
+    gou_surface_end_cpu_access(surface, GOU_SURFACE_ACCESS_WRITE, NULL);
+
+    return surface;
+}
+
+static bool Capture(gou_display_t* display, image_t* outImage)
+{
+    unlink(SCREENSHOT_FILE);
+
+    if (!gou_display_screenshot(display, SCREENSHOT_FILE))
+    {
+        return false;
+    }
+
+    gou_display_screenshot_flush(display);
+
+    png_image png;
+    memset(&png, 0, sizeof(png));
+    png.version = PNG_IMAGE_VERSION;
+
+    if (!png_image_begin_read_from_file(&png, SCREENSHOT_FILE))
+    {
+        return false;
+    }
+
+    png.format = PNG_FORMAT_RGB;
+    outImage->resize(PNG_IMAGE_SIZE(png));
+
+    return png_image_finish_read(&png, NULL, outImage->data(), 0, NULL) != 0;
+}
+
+static uint32_t Pixel(gou_display_t* display, const image_t& image, int x, int y)
+{
+    const uint8_t* rgb = &image[(y * gou_display_width_get(display) + x) * 3];
+    return 0xff000000 | (rgb[0] << 16) | (rgb[1] << 8) | rgb[2];
+}
+
+static int ChannelDifference(uint32_t a, uint32_t b)
+{
+    int result = 0;
+    for (int shift = 0; shift < 24; shift += 8)
+    {
+        const int difference = abs((int)((a >> shift) & 0xff) - (int)((b >> shift) & 0xff));
+        if (difference > result)
+        {
+            result = difference;
+        }
+    }
+
+    return result;
+}
+
+static bool Render(gou_display_t* display, const gou_display_layer_t* layers, int count, image_t* outImage)
+{
+    gou_display_background_color_set(display, 0xffff0000);
+
+    // Every flip buffer is drawn so the capture shows this frame
+    for (int i = 0; i < gou_display_buffer_count_get(display) + 1; ++i)
+    {
+        gou_display_present_layers(display, layers, count);
+    }
+
+    usleep(100 * 1000);
+
+    return Capture(display, outImage);
+}
+
+
+// Scene 0: every third pixel of a sub-rectangle, scaled down with NEAREST
+// Scene 1: a whole surface scaled up 2x with NEAREST
+// Scene 2: an opaque surface at half global alpha over the background
+#define SCENE_COUNT (3)
+
+static void SceneLayer(gou_surface_t* pattern, int scene, gou_display_layer_t* outLayer)
+{
+    memset(outLayer, 0, sizeof(*outLayer));
+    outLayer->surface = pattern;
+    outLayer->alpha = 0xff;
+    outLayer->filter = GOU_SCALE_FILTER_NEAREST;
+
+    switch (scene)
+    {
+        case 0:
+            outLayer->src = { 6, 9, 90, 48 };
+            outLayer->dst = { 10, 10, 30, 16 };
+            break;
+
+        case 1:
+            outLayer->src = { 0, 0, PATTERN_WIDTH, PATTERN_HEIGHT };
+            outLayer->dst = { 50, 50, PATTERN_WIDTH * 2, PATTERN_HEIGHT * 2 };
+            break;
+
+        default:
+            outLayer->src = { 0, 0, PATTERN_WIDTH, PATTERN_HEIGHT };
+            outLayer->dst = { 300, 50, PATTERN_WIDTH, PATTERN_HEIGHT };
+            outLayer->alpha = 0x80;
+            break;
+    }
+}
+
+static uint32_t SceneExpected(int scene, const gou_display_layer_t& layer, int x, int y)
+{
+    switch (scene)
+    {
+        case 0:
+            // Centre of each 3 x 3 block
+            return PatternColor(layer.src.x + x * 3 + 1, layer.src.y + y * 3 + 1);
+
+        case 1:
+            return PatternColor(x / 2, y / 2);
+
+        default:
+        {
+            // Background is blue
+            const uint32_t src = PatternColor(x, y);
+            uint32_t result = 0xff000000;
+            for (int shift = 0; shift < 24; shift += 8)
+            {
+                const uint32_t s = (src >> shift) & 0xff;
+                const uint32_t d = (shift == 0) ? 0xff : 0;
+                result |= ((s * 0x80 + d * 0x7f + 127) / 255) << shift;
+            }
+            return result;
+        }
+    }
+}
+
+static void CheckSoftware(gou_display_t* display, gou_surface_t* pattern, std::vector<image_t>* outImages)
+{
+    static const char* names[SCENE_COUNT] = {
+        "software nearest downscale samples block centres",
+        "software nearest upscale repeats pixels",
+        "software global alpha blends opaque layers"
+    };
+
+    outImages->resize(SCENE_COUNT);
+
+    for (int scene = 0; scene < SCENE_COUNT; ++scene)
+    {
+        gou_display_layer_t layer;
+        SceneLayer(pattern, scene, &layer);
+
+        image_t& image = (*outImages)[scene];
+        if (!Render(display, &layer, 1, &image))
+        {
+            Check(false, names[scene]);
+            continue;
+        }
+
+        // Blending rounds differently to the formula above
+        const int tolerance = (scene == 2) ? 1 : 0;
+
+        bool match = true;
+        for (int y = 0; y < layer.dst.height && match; ++y)
+        {
+            for (int x = 0; x < layer.dst.width && match; ++x)
+            {
+                const uint32_t shown = Pixel(display, image, layer.dst.x + x, layer.dst.y + y);
+                const uint32_t expected = SceneExpected(scene, layer, x, y);
+
+                if (ChannelDifference(shown, expected) > tolerance)
+                {
+                    printf("  (%d, %d): shown %06x, expected %06x\n", x, y, shown & 0xffffff, expected & 0xffffff);
+                    match = false;
+                }
+            }
+        }
+
+        Check(match, names[scene]);
+    }
+}
+
+static void CheckHardware(const std::vector<image_t>& oracle)
+{
+    if (access("/dev/fb0", R_OK | W_OK) != 0 || access("/dev/ge2d", R_OK | W_OK) != 0)
+    {
+        printf("skip: no GE2D to compare with the software engine\n");
+        return;
+    }
+
+    gou_display_options_t options;
+    memset(&options, 0, sizeof(options));
+
+    gou_display_t* display = gou_display_create_ex(&options);
+    gou_surface_t* pattern = CreatePattern(display, PATTERN_WIDTH, PATTERN_HEIGHT);
+
+    for (int scene = 0; scene < SCENE_COUNT; ++scene)
+    {
+        gou_display_layer_t layer;
+        SceneLayer(pattern, scene, &layer);
+
+        image_t image;
+        bool match = Render(display, &layer, 1, &image) && image.size() == oracle[scene].size();
+
+        const int width = gou_display_width_get(display);
+        for (int y = 0; y < layer.dst.height && match; ++y)
+        {
+            for (int x = 0; x < layer.dst.width && match; ++x)
+            {
+                const size_t offset = ((layer.dst.y + y) * width + layer.dst.x + x) * 3;
+                for (int c = 0; c < 3; ++c)
+                {
+                    if (abs((int)image[offset + c] - (int)oracle[scene][offset + c]) > ((scene == 2) ? 1 : 0))
+                    {
+                        printf("  scene %d (%d, %d): hardware differs from the software engine\n", scene, x, y);
+                        match = false;
+                    }
+                }
+            }
+        }
+
+        Check(match, "hardware matches the software engine");
+    }
+
+    gou_surface_destroy(pattern);
+    gou_display_destroy(display);
+}
+
+
+int main()
+{
+    gou_display_options_t options;
+    memset(&options, 0, sizeof(options));
+    options.virtual_display = true;
+
+    gou_display_t* display = gou_display_create_ex(&options);
+    gou_surface_t* pattern = CreatePattern(display, PATTERN_WIDTH, PATTERN_HEIGHT);
+
+    std::vector<image_t> images;
+    CheckSoftware(display, pattern, &images);
+
+    gou_surface_destroy(pattern);
+    gou_display_destroy(display);
+
+    CheckHardware(images);
+
+    unlink(SCREENSHOT_FILE);
+
+    printf("%d failure(s)\n", failures);
+    return failures ? 1 : 0;
+}